@@ -27,18 +27,31 @@ class GpuBuffer
     GpuBuffer& operator=(GpuBuffer&&) = default;
     ~GpuBuffer() = default;
 
-    // Create new
+    // Create new, recycled from the context's memory pool when pooling is enabled
     GpuBuffer(std::shared_ptr<gls::OCLContext> gpu_context, const size_t size, cl_mem_flags flags = CL_MEM_READ_WRITE)
-        : gpu_context_(gpu_context), size_(size), is_mapped_(std::make_shared<std::atomic<bool>>(false))
+        : GpuBuffer(gpu_context, size, OCLMemoryPool::Key{.bytes = sizeof(T) * size, .flags = flags}){};
+
+    // Create new, pooled under pool_key. Images key their backing buffers by shape and format as well, so that the
+    // image created on a recycled buffer can be recycled with it.
+    GpuBuffer(std::shared_ptr<gls::OCLContext> gpu_context, const size_t size, const OCLMemoryPool::Key& pool_key)
+        : size_(size), gpu_context_(gpu_context), is_mapped_(std::make_shared<std::atomic<bool>>(false))
     {
         /// TODO: pitch for image? Or create croppable "buffer-based" images?
-        buffer_ = cl::Buffer(gpu_context->clContext(), flags, sizeof(T) * size);
+        if (auto pool = gpu_context->memoryPool())
+        {
+            pool_block_ = pool->acquire(pool_key);
+            buffer_ = pool_block_->buffer;
+        }
+        else
+        {
+            buffer_ = cl::Buffer(gpu_context->clContext(), pool_key.flags, pool_key.bytes);
+        }
     };
 
     // Create from CPU span
     GpuBuffer(std::shared_ptr<gls::OCLContext> gpu_context, const std::span<T>& data,
               cl_mem_flags flags = CL_MEM_READ_WRITE)
-        : gpu_context_(gpu_context), size_(data.size()), is_mapped_(std::make_shared<std::atomic<bool>>(false))
+        : size_(data.size()), gpu_context_(gpu_context), is_mapped_(std::make_shared<std::atomic<bool>>(false))
     {
         buffer_ = cl::Buffer(gpu_context->clContext(), flags | CL_MEM_COPY_HOST_PTR, sizeof(T) * size_, data.data());
     };
@@ -47,9 +60,10 @@ class GpuBuffer
     /// NOTE: I don't know if this works recursively
     GpuBuffer(std::shared_ptr<gls::OCLContext> gpu_context, GpuBuffer<T>& other, std::optional<size_t> offset = {},
               std::optional<size_t> size = {}, cl_mem_flags flags = CL_MEM_READ_WRITE)
-        : gpu_context_(gpu_context),
-          size_(size.value_or(other.size_ - offset.value_or(0))),
+        : size_(size.value_or(other.size_ - offset.value_or(0))),
+          gpu_context_(gpu_context),
           is_mapped_(other.is_mapped_),
+          pool_block_(other.pool_block_),
           is_crop_(true)
     {
         // Recursive cropping gave me a segfault - rather crop from the original again with appropriate offset.
@@ -85,8 +99,8 @@ class GpuBuffer
 
     /// Warp the cl::Buffer
     GpuBuffer(std::shared_ptr<gls::OCLContext> gpu_context, cl::Buffer buffer)
-        : gpu_context_(gpu_context),
-          size_(buffer.getInfo<CL_MEM_SIZE>() / sizeof(T)),
+        : size_(buffer.getInfo<CL_MEM_SIZE>() / sizeof(T)),
+          gpu_context_(gpu_context),
           is_mapped_(std::make_shared<std::atomic<bool>>(false)),
           buffer_(buffer)
     {
@@ -104,7 +118,9 @@ class GpuBuffer
     {
         cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
         std::vector<T> data(size_);
-        _queue.enqueueReadBuffer(buffer_, CL_TRUE, 0, size_ * sizeof(T), data.data(), &events);
+        cl::Event event;
+        _queue.enqueueReadBuffer(buffer_, CL_TRUE, 0, size_ * sizeof(T), data.data(), &events, &event);
+        gpu_context_->profile("GpuBuffer::ToVector", "transfer", cl::NDRange(size_), event);
         return data;
     };
 
@@ -117,6 +133,7 @@ class GpuBuffer
         cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
         cl::Event event;
         _queue.enqueueWriteBuffer(buffer_, CL_FALSE, 0, size_ * sizeof(T), data.data(), &events, &event);
+        gpu_context_->profile("GpuBuffer::CopyFrom", "transfer", cl::NDRange(size_), event);
         return event;
     };
 
@@ -129,6 +146,7 @@ class GpuBuffer
         cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
         cl::Event event;
         _queue.enqueueReadBuffer(buffer_, CL_FALSE, 0, size_ * sizeof(T), data.data(), &events, &event);
+        gpu_context_->profile("GpuBuffer::CopyTo", "transfer", cl::NDRange(size_), event);
         return event;
     }
 
@@ -138,7 +156,10 @@ class GpuBuffer
         if (is_mapped_->load()) throw std::runtime_error("MapBuffer() called on a buffer that is already mapped.");
 
         cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
-        void* ptr = _queue.enqueueMapBuffer(buffer_, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size_ * sizeof(T));
+        cl::Event event;
+        void* ptr = _queue.enqueueMapBuffer(buffer_, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size_ * sizeof(T), nullptr,
+                                            &event);
+        gpu_context_->profile("GpuBuffer::MapBuffer", "transfer", cl::NDRange(size_), event);
 
         // Create custom deleter that unmaps the buffer
         auto deleter = [this, ptr, _queue, events](std::span<T>* span) mutable
@@ -158,6 +179,8 @@ class GpuBuffer
     const size_t size_;
     size_t ByteSize() const { return size_ * sizeof(T); };
     cl::Buffer buffer() const { return buffer_; };
+    // The memory pool block backing this buffer, or nullptr if it isn't pooled
+    std::shared_ptr<OCLMemoryPool::Block> pool_block() const { return pool_block_; };
 
    private:
     std::shared_ptr<gls::OCLContext> gpu_context_;
@@ -166,6 +189,9 @@ class GpuBuffer
     /// allowed to be mapped at the same time if they share the same underlying buffer.
     std::shared_ptr<std::atomic<bool>> is_mapped_;
 
+    // Keeps pooled memory out of the pool for as long as any GpuBuffer or GpuImage sharing it is alive
+    std::shared_ptr<OCLMemoryPool::Block> pool_block_;
+
     cl::Buffer buffer_;
     const bool is_crop_ = false;
 };
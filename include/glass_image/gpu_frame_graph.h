@@ -0,0 +1,117 @@
+#pragma once
+
+#include <format>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "glass_image/gpu_buffer.h"
+#include "glass_image/gpu_image.h"
+#include "glass_image/gpu_utils.h"
+#include "gls_ocl.hpp"
+
+namespace gls
+{
+
+/// Handle of a transient image declared in a GpuFrameGraph, resolved with GpuFrameGraph::Image() once compiled.
+template <typename T>
+struct GpuTransientImage
+{
+    size_t id;
+};
+
+/// Records a chain of kernel launches over transient intermediate images, computes the lifetime of each image from the
+/// passes using it and aliases the images whose lifetimes don't overlap onto the same device memory, as sub-buffers
+/// of a single backing buffer. Peak memory is then bound by the largest set of images alive at the same time instead
+/// of by all the intermediates of the chain.
+///
+/// Passes are run in recording order and must enqueue their work on the same in-order command queue: no event
+/// dependencies are added between passes sharing memory. Images which have to outlive the graph (inputs and outputs)
+/// are regular GpuImages captured by the passes.
+class GpuFrameGraph
+{
+   public:
+    using ResourceId = size_t;
+
+    /// Size and lifetime of a transient resource, first_pass and last_pass are inclusive pass indices.
+    struct TransientRange
+    {
+        size_t bytes = 0;
+        size_t first_pass, last_pass;
+        size_t offset = 0;  // Assigned by PlanTransientMemory
+    };
+
+    GpuFrameGraph(std::shared_ptr<gls::OCLContext> gpu_context) : gpu_context_(gpu_context) {}
+
+    template <typename T>
+    GpuTransientImage<T> CreateImage(const size_t width, const size_t height, cl_mem_flags flags = CL_MEM_READ_WRITE)
+    {
+        if (backing_) throw std::runtime_error("CreateImage() called on a GpuFrameGraph that is already compiled.");
+
+        const size_t bytes = image_utils::GetBestRowPitch<T>(width) * height * sizeof(T);
+        auto create = [gpu_context = gpu_context_, width, height, flags](const cl::Buffer& backing, size_t offset)
+        {
+            GpuBuffer<T> buffer(gpu_context, backing);
+            return std::static_pointer_cast<void>(
+                std::make_shared<GpuImage<T>>(gpu_context, buffer, width, height, offset / sizeof(T), flags));
+        };
+        resources_.push_back({.bytes = bytes, .create = create});
+        return GpuTransientImage<T>{resources_.size() - 1};
+    }
+
+    /// Record a pass reading and writing the given transient resources, execute enqueues its work and returns the
+    /// event of its last command.
+    void AddPass(const std::string& name, const std::vector<ResourceId>& reads, const std::vector<ResourceId>& writes,
+                 std::function<cl::Event()> execute);
+
+    /// Plan the memory of the transient resources and create them, called by the first Execute() if needed.
+    void Compile();
+
+    /// Run all the passes in order, returns the event of the last one.
+    cl::Event Execute();
+
+    template <typename T>
+    GpuImage<T>& Image(const GpuTransientImage<T>& handle)
+    {
+        if (!backing_) throw std::runtime_error("Image() called on a GpuFrameGraph that isn't compiled.");
+        if (!resources_[handle.id].image)
+            throw std::runtime_error(std::format("Transient image {} is not used by any pass.", handle.id));
+        return *std::static_pointer_cast<GpuImage<T>>(resources_[handle.id].image);
+    }
+
+    /// Sum of the sizes of all the transient resources, i.e.: the memory needed without aliasing.
+    size_t TransientBytes() const;
+
+    /// Size of the backing buffer shared by all transient resources.
+    size_t AllocatedBytes() const { return backing_ ? backing_->ByteSize() : 0; }
+
+    /// Assign offsets to ranges so that ranges with overlapping lifetimes never overlap in memory, offsets are
+    /// multiples of alignment. Larger resources are placed first, each at the lowest offset that fits.
+    /// @return The total memory needed
+    static size_t PlanTransientMemory(std::vector<TransientRange>& ranges, size_t alignment);
+
+   private:
+    struct Resource
+    {
+        size_t bytes;
+        std::function<std::shared_ptr<void>(const cl::Buffer& backing, size_t offset)> create;
+        std::shared_ptr<void> image = nullptr;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<ResourceId> reads, writes;
+        std::function<cl::Event()> execute;
+    };
+
+    std::shared_ptr<gls::OCLContext> gpu_context_;
+    std::vector<Resource> resources_;
+    std::vector<Pass> passes_;
+    std::optional<GpuBuffer<uint8_t>> backing_;
+};
+
+}  // namespace gls
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "glass_image/gpu_image.h"
+#include "gls_image.hpp"
+#include "gls_ocl.hpp"
+
+namespace gls
+{
+
+/// Streams frames through a GPU computation, overlapping the upload of frame n + 1, the compute of frame n and the
+/// readback of frame n - 1 on three command queues. The pipeline rotates through a fixed number of slots, each with its
+/// own input and output GpuImage and pinned (CL_MEM_ALLOC_HOST_PTR) host staging buffers, so steady state streaming
+/// performs no allocations besides the returned images and transfers run at pinned memory speed.
+///
+/// Submit() returns as soon as the frame is copied to its staging buffer; it blocks only when all the slots are in
+/// flight. Results are delivered in submission order by a completion thread. Submit() can be called from several
+/// threads, a frame whose upload or compute fails releases its slot and rethrows.
+template <typename TIn, typename TOut>
+class GpuFramePipeline
+{
+   public:
+    /// Enqueue the computation of output from input on queue, after wait_events, and return the event of its last
+    /// command.
+    using Compute = std::function<cl::Event(const GpuImage<TIn>& input, GpuImage<TOut>& output,
+                                            const cl::CommandQueue& queue, const std::vector<cl::Event>& wait_events)>;
+
+    GpuFramePipeline(std::shared_ptr<gls::OCLContext> gpu_context, const gls::size& input_size,
+                     const gls::size& output_size, Compute compute, size_t slot_count = 3)
+        : gpu_context_(gpu_context),
+          input_size_(input_size),
+          output_size_(output_size),
+          compute_(compute),
+          upload_queue_(gpu_context->clContext(), cl::Device::getDefault()),
+          compute_queue_(gpu_context->clContext(), cl::Device::getDefault()),
+          download_queue_(gpu_context->clContext(), cl::Device::getDefault())
+    {
+        if (slot_count == 0) throw std::runtime_error("GpuFramePipeline needs at least one slot.");
+
+        const size_t input_bytes = input_size.width * input_size.height * sizeof(TIn);
+        const size_t output_bytes = output_size.width * output_size.height * sizeof(TOut);
+        for (size_t i = 0; i < slot_count; i++)
+        {
+            auto slot = std::make_unique<Slot>(Slot{
+                .input = GpuImage<TIn>(gpu_context, input_size.width, input_size.height, CL_MEM_READ_ONLY),
+                .output = GpuImage<TOut>(gpu_context, output_size.width, output_size.height, CL_MEM_WRITE_ONLY),
+                .input_staging = cl::Buffer(gpu_context->clContext(), CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                            input_bytes),
+                .output_staging = cl::Buffer(gpu_context->clContext(), CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                             output_bytes)});
+
+            // The staging buffers stay mapped for the lifetime of the pipeline, transfers use their host pointers
+            slot->input_host = static_cast<TIn*>(
+                upload_queue_.enqueueMapBuffer(slot->input_staging, CL_TRUE, CL_MAP_WRITE, 0, input_bytes));
+            slot->output_host = static_cast<TOut*>(
+                download_queue_.enqueueMapBuffer(slot->output_staging, CL_TRUE, CL_MAP_READ, 0, output_bytes));
+            slots_.push_back(std::move(slot));
+        }
+
+        completion_thread_ = std::thread([this] { CompleteFrames(); });
+    }
+
+    GpuFramePipeline(const GpuFramePipeline&) = delete;
+    GpuFramePipeline& operator=(const GpuFramePipeline&) = delete;
+
+    /// Waits for all the submitted frames to complete.
+    ~GpuFramePipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        condition_.notify_all();
+        completion_thread_.join();
+
+        for (auto& slot : slots_)
+        {
+            upload_queue_.enqueueUnmapMemObject(slot->input_staging, slot->input_host);
+            download_queue_.enqueueUnmapMemObject(slot->output_staging, slot->output_host);
+        }
+        upload_queue_.finish();
+        download_queue_.finish();
+    }
+
+    /// Submit a frame, the caller can reuse it as soon as Submit() returns.
+    std::future<typename gls::image<TOut>::unique_ptr> Submit(const gls::image<TIn>& frame)
+    {
+        if (frame.width != input_size_.width || frame.height != input_size_.height)
+            throw std::runtime_error(std::format("GpuFramePipeline expected a frame of size {}x{}, got {}x{}.",
+                                                 input_size_.width, input_size_.height, frame.width, frame.height));
+
+        Slot* slot_ptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            slot_ptr = slots_[next_slot_].get();
+            next_slot_ = (next_slot_ + 1) % slots_.size();
+            condition_.wait(lock, [slot_ptr] { return !slot_ptr->busy; });
+            slot_ptr->busy = true;
+        }
+        Slot& slot = *slot_ptr;
+
+        cl::Event downloaded;
+        try
+        {
+            // The slot's previous frame is complete, its staging buffers are free
+            gls::image<TIn> staged_input(frame.width, frame.height, frame.width,
+                                         std::span<TIn>(slot.input_host, frame.width * frame.height));
+            for (int y = 0; y < frame.height; y++) std::copy(frame[y], frame[y] + frame.width, staged_input[y]);
+
+            gls::image<TOut> staged_output(output_size_.width, output_size_.height, output_size_.width,
+                                           std::span<TOut>(slot.output_host, output_size_.width * output_size_.height));
+
+            // Queues are flushed right away so that the other queues waiting on their events can make progress
+            cl::Event uploaded = slot.input.CopyFrom(staged_input, upload_queue_);
+            upload_queue_.flush();
+            cl::Event computed = compute_(slot.input, slot.output, compute_queue_, {uploaded});
+            compute_queue_.flush();
+            downloaded = slot.output.CopyTo(staged_output, download_queue_, {computed});
+            download_queue_.flush();
+        }
+        catch (...)
+        {
+            // Release the slot once the commands already enqueued on it are done, or the next Submit() picking it
+            // would wait forever
+            try
+            {
+                upload_queue_.finish();
+                compute_queue_.finish();
+            }
+            catch (...)
+            {
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slot.busy = false;
+            }
+            condition_.notify_all();
+            throw;
+        }
+
+        std::promise<typename gls::image<TOut>::unique_ptr> promise;
+        auto future = promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back({.slot = &slot, .event = downloaded, .promise = std::move(promise)});
+        }
+        condition_.notify_all();
+        return future;
+    }
+
+    /// Wait for all the submitted frames to complete.
+    void Finish()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return pending_.empty() && !completing_; });
+    }
+
+    size_t SlotCount() const { return slots_.size(); }
+
+   private:
+    struct Slot
+    {
+        GpuImage<TIn> input;
+        GpuImage<TOut> output;
+        cl::Buffer input_staging, output_staging;
+        TIn* input_host = nullptr;
+        TOut* output_host = nullptr;
+        bool busy = false;  // Guarded by mutex_
+    };
+
+    struct Pending
+    {
+        Slot* slot;
+        cl::Event event;
+        std::promise<typename gls::image<TOut>::unique_ptr> promise;
+    };
+
+    /// Completion thread: copies the readbacks out of the staging buffers, in order, and releases their slots.
+    void CompleteFrames()
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (pending_.empty()) return;
+
+            Pending pending = std::move(pending_.front());
+            pending_.pop_front();
+            completing_ = true;
+            lock.unlock();
+
+            try
+            {
+                pending.event.wait();
+                auto result = std::make_unique<gls::image<TOut>>(output_size_.width, output_size_.height);
+                for (int y = 0; y < result->height; y++)
+                {
+                    const TOut* row = pending.slot->output_host + y * output_size_.width;
+                    std::copy(row, row + result->width, (*result)[y]);
+                }
+                pending.promise.set_value(std::move(result));
+            }
+            catch (...)
+            {
+                pending.promise.set_exception(std::current_exception());
+            }
+
+            lock.lock();
+            pending.slot->busy = false;
+            completing_ = false;
+            lock.unlock();
+            condition_.notify_all();
+        }
+    }
+
+    std::shared_ptr<gls::OCLContext> gpu_context_;
+    const gls::size input_size_, output_size_;
+    Compute compute_;
+    cl::CommandQueue upload_queue_, compute_queue_, download_queue_;
+
+    std::vector<std::unique_ptr<Slot>> slots_;
+    size_t next_slot_ = 0;  // Guarded by mutex_
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<Pending> pending_;
+    bool completing_ = false;
+    bool stopping_ = false;
+    std::thread completion_thread_;
+};
+
+}  // namespace gls
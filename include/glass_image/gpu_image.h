@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "glass_image/gpu_buffer.h"
+#include "glass_image/gpu_pinned_image.h"
 #include "gls_image.hpp"
 #include "gls_ocl.hpp"
 
@@ -37,6 +38,10 @@ class GpuImage
 
     GpuImage(std::shared_ptr<gls::OCLContext> gpu_context, cl::Image2D image);
 
+    // Zero-copy GpuImage on the pinned buffer of a PinnedImage, see CopyFrom(PinnedImage&) and CopyTo(PinnedImage&)
+    GpuImage(std::shared_ptr<gls::OCLContext> gpu_context, PinnedImage<T>& pinned,
+             cl_mem_flags flags = CL_MEM_READ_WRITE);
+
     /// Check if this GpuImage is backed by a buffer
     bool is_buffer_based() const { return buffer_.has_value(); }
 
@@ -64,6 +69,21 @@ class GpuImage
     cl::Event CopyTo(gls::image<T>& image, std::optional<cl::CommandQueue> queue = std::nullopt,
                      const std::vector<cl::Event>& events = {});
 
+    /// Transfers from and to pinned memory. If this image was created on the PinnedImage's buffer no data is copied,
+    /// the PinnedImage is unmapped (CopyFrom) or mapped (CopyTo) instead. Otherwise the PinnedImage must be mapped and
+    /// the pixels are copied straight from or to pinned memory.
+    cl::Event CopyFrom(PinnedImage<T>& image, std::optional<cl::CommandQueue> queue = std::nullopt,
+                       const std::vector<cl::Event>& events = {});
+
+    cl::Event CopyTo(PinnedImage<T>& image, std::optional<cl::CommandQueue> queue = std::nullopt,
+                     const std::vector<cl::Event>& events = {});
+
+    /// Check if this GpuImage was created on the buffer of image
+    bool IsBackedBy(const PinnedImage<T>& image) const
+    {
+        return buffer_.has_value() && buffer_->buffer()() == image.buffer()();
+    }
+
     cl::Event Fill(const T& value, std::optional<cl::CommandQueue> queue = std::nullopt,
                    const std::vector<cl::Event>& events = {});
 
@@ -73,6 +93,16 @@ class GpuImage
     void ApplyOnCpu(std::function<void(T* pixel, int x, int y)> process,
                     std::optional<cl::CommandQueue> queue = std::nullopt, const std::vector<cl::Event>& events = {});
 
+    /// Map the image and run process on every pixel in parallel, see gls::image::parallel_for_each_pixel().
+    template <typename Process>
+    void ParallelApplyOnCpu(Process&& process, int max_threads = 0,
+                            std::optional<cl::CommandQueue> queue = std::nullopt,
+                            const std::vector<cl::Event>& events = {})
+    {
+        auto mapped_image = MapImage(queue, events);
+        mapped_image->parallel_for_each_pixel(std::forward<Process>(process), max_threads);
+    }
+
     const size_t width_, height_, row_pitch_;  // In pixels
     // cl::Image2D image() { return image_; };
     const cl::Image2D image() const { return image_; };
@@ -89,6 +119,9 @@ class GpuImage
     cl::Image2D CreateImage2dFromBuffer(GpuBuffer<T>& buffer, const size_t offset, const size_t row_pitch,
                                         const size_t width, const size_t height, cl_mem_flags flags);
 
+    /// @brief Creates the image on the whole of buffer_, reusing the image of a recycled memory pool block.
+    cl::Image2D CreateImage2d();
+
     // General
     std::shared_ptr<std::atomic<bool>> is_mapped_;
     const cl_mem_flags flags_;
@@ -92,6 +92,10 @@ class GpuKernel
         }
     }
 
+    /// Enqueue the kernel with the arguments set by SetArgs(), reporting the dispatch to the context's profiler.
+    cl::Event Enqueue(const cl::NDRange& global_size, const cl::NDRange& local_size = cl::NullRange,
+                      std::optional<cl::CommandQueue> queue = std::nullopt, const std::vector<cl::Event>& events = {});
+
     std::shared_ptr<gls::OCLContext> gpu_context_;
 
    protected:
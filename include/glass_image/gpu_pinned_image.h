@@ -0,0 +1,100 @@
+#pragma once
+
+#include <format>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "glass_image/gpu_utils.h"
+#include "gls_image.hpp"
+#include "gls_ocl.hpp"
+
+namespace gls
+{
+
+/// Storage of a PinnedImage, a base class so that it is allocated before the gls::image wrapping it.
+struct PinnedImageStorage
+{
+    std::shared_ptr<gls::OCLContext> gpu_context_;
+    cl::Buffer buffer_;
+    void* host_ = nullptr;
+    bool is_mapped_ = false;
+
+    PinnedImageStorage(std::shared_ptr<gls::OCLContext> gpu_context, size_t bytes)
+        : gpu_context_(gpu_context),
+          buffer_(gpu_context->clContext(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes)
+    {
+        host_ = gpu_context->clCommandQueue().enqueueMapBuffer(buffer_, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes);
+        is_mapped_ = true;
+    }
+};
+
+/// A gls::image allocated in pinned, device accessible host memory: a mapped CL_MEM_ALLOC_HOST_PTR buffer. Transfers
+/// from and to pinned memory run at DMA speed, with no driver bounce buffer, and a GpuImage can be created directly on
+/// the pinned buffer, see GpuImage(gpu_context, PinnedImage&). Transfers between the two are then zero-copy: the
+/// GpuImage's CopyFrom() and CopyTo() only unmap and map the buffer, which costs nothing on unified memory devices.
+///
+/// Rows are padded to GetBestRowPitch(), as the rows of GpuImages. The image is mapped at construction; while unmapped
+/// its pixels must not be accessed. The buffer is not guaranteed to be mapped at the same address every time, so
+/// pointers and views into the pixels are only valid until the next Unmap().
+template <typename T>
+class PinnedImage : private PinnedImageStorage, public gls::image<T>
+{
+   public:
+    PinnedImage(std::shared_ptr<gls::OCLContext> gpu_context, int width, int height)
+        : PinnedImage(gpu_context, width, height, image_utils::GetBestRowPitch<T>(width))
+    {
+    }
+
+    PinnedImage(const PinnedImage&) = delete;
+    PinnedImage& operator=(const PinnedImage&) = delete;
+
+    ~PinnedImage()
+    {
+        if (is_mapped_) gpu_context_->clCommandQueue().enqueueUnmapMemObject(buffer_, host_);
+        gpu_context_->clCommandQueue().finish();
+    }
+
+    const cl::Buffer& buffer() const { return buffer_; }
+
+    bool is_mapped() const { return is_mapped_; }
+
+    /// Hand the pixels over to the device, the host must not access them until the next Map().
+    cl::Event Unmap(std::optional<cl::CommandQueue> queue = std::nullopt, const std::vector<cl::Event>& events = {})
+    {
+        if (!is_mapped_) throw std::runtime_error("Unmap() called on a PinnedImage that is not mapped.");
+
+        cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
+        cl::Event event;
+        _queue.enqueueUnmapMemObject(buffer_, host_, &events, &event);
+        is_mapped_ = false;
+        return event;
+    }
+
+    /// Hand the pixels back to the host, they can be accessed once the returned event is complete. The image is
+    /// retargeted to the new mapping.
+    cl::Event Map(std::optional<cl::CommandQueue> queue = std::nullopt, const std::vector<cl::Event>& events = {})
+    {
+        if (is_mapped_) throw std::runtime_error("Map() called on a PinnedImage that is already mapped.");
+
+        cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
+        cl::Event event;
+        const size_t size = (size_t)this->stride * this->height;
+        host_ = _queue.enqueueMapBuffer(buffer_, CL_FALSE, CL_MAP_READ | CL_MAP_WRITE, 0, size * sizeof(T), &events,
+                                        &event);
+        is_mapped_ = true;
+        gls::image<T>::operator=(
+            gls::image<T>(this->width, this->height, this->stride, std::span<T>(static_cast<T*>(host_), size)));
+        return event;
+    }
+
+   private:
+    PinnedImage(std::shared_ptr<gls::OCLContext> gpu_context, int width, int height, size_t stride)
+        : PinnedImageStorage(gpu_context, stride * height * sizeof(T)),
+          gls::image<T>(width, height, (int)stride, std::span<T>(static_cast<T*>(host_), stride * height))
+    {
+    }
+};
+
+}  // namespace gls
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "glass_image/gpu_buffer.h"
+#include "glass_image/gpu_image.h"
+#include "glass_image/gpu_image_3d.h"
+#include "gls_image.hpp"
+#include "gls_ocl.hpp"
+
+namespace gls
+{
+
+/// Device memory read or written by a GpuScheduler operation.
+struct GpuAccess
+{
+    cl::Memory memory;
+    bool write;
+};
+
+template <typename T>
+GpuAccess GpuRead(const GpuBuffer<T>& buffer)
+{
+    return {buffer.buffer(), false};
+}
+
+template <typename T>
+GpuAccess GpuRead(const GpuImage<T>& image)
+{
+    return {image.image(), false};
+}
+
+template <typename T>
+GpuAccess GpuRead(const GpuImage3d<T>& image)
+{
+    return {image.image(), false};
+}
+
+template <typename T>
+GpuAccess GpuWrite(const GpuBuffer<T>& buffer)
+{
+    return {buffer.buffer(), true};
+}
+
+template <typename T>
+GpuAccess GpuWrite(const GpuImage<T>& image)
+{
+    return {image.image(), true};
+}
+
+template <typename T>
+GpuAccess GpuWrite(const GpuImage3d<T>& image)
+{
+    return {image.image(), true};
+}
+
+/// Issues a DAG of uploads, kernels, readbacks and host operations over several command queues. Operations are
+/// recorded in program order together with the memory they read and write, and the scheduler derives the
+/// read-after-write, write-after-read and write-after-write hazards between them. Images, the buffers they are created
+/// from and sub-buffers are resolved to ranges of the same underlying allocation, so aliased memory is tracked too.
+///
+/// Each operation only waits on the events it needs: dependencies already implied by the in-order queue it runs on, or
+/// by the dependencies of its other dependencies, are dropped. With three or more queues uploads, compute and readbacks
+/// each get their own queue and overlap. Execute() can be called once per frame: the hazards between an operation and
+/// the later operations of the previous frame are honored as well.
+///
+/// The resources and host memory captured by the operations have to outlive the scheduler's executions.
+class GpuScheduler
+{
+   public:
+    using OperationId = size_t;
+
+    /// Enqueue the operation on queue, after wait_events, and return the event of its last command.
+    using Enqueue = std::function<cl::Event(const cl::CommandQueue& queue, const std::vector<cl::Event>& wait_events)>;
+
+    /// What an operation does, selects its queue. Host operations run on the calling thread.
+    enum class Stream
+    {
+        kUpload = 0,
+        kCompute = 1,
+        kDownload = 2,
+        kHost = 3,
+    };
+
+    /// Byte range of an allocation, root is the memory object which owns the storage.
+    struct MemoryRange
+    {
+        cl_mem root;
+        size_t offset, size;
+
+        bool Overlaps(const MemoryRange& other) const
+        {
+            return root == other.root && offset < other.offset + other.size && other.offset < offset + size;
+        }
+    };
+
+    /// Creates queue_count new queues on the context's device, with the given properties. Out of order queues
+    /// (CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) get an explicit wait for every dependency.
+    GpuScheduler(std::shared_ptr<gls::OCLContext> gpu_context, size_t queue_count = 3,
+                 cl_command_queue_properties properties = 0);
+
+    OperationId AddOperation(const std::string& name, Stream stream, const std::vector<GpuAccess>& accesses,
+                             Enqueue enqueue);
+
+    OperationId Kernel(const std::string& name, const std::vector<GpuAccess>& accesses, Enqueue enqueue)
+    {
+        return AddOperation(name, Stream::kCompute, accesses, enqueue);
+    }
+
+    /// Run work on the host once the operations it depends on are complete, e.g.: to process a mapped image. Execute()
+    /// blocks until then, the operations recorded before are already issued and keep running.
+    OperationId HostOperation(const std::string& name, const std::vector<GpuAccess>& accesses,
+                              std::function<void()> work);
+
+    template <typename T>
+    OperationId Upload(GpuBuffer<T>& buffer, std::span<T> data)
+    {
+        return AddOperation("Upload", Stream::kUpload, {GpuWrite(buffer)},
+                            [&buffer, data](const cl::CommandQueue& queue, const std::vector<cl::Event>& events)
+                            { return buffer.CopyFrom(data, queue, events); });
+    }
+
+    template <typename T>
+    OperationId Upload(GpuImage<T>& image, const gls::image<T>& data)
+    {
+        return AddOperation("Upload", Stream::kUpload, {GpuWrite(image)},
+                            [&image, &data](const cl::CommandQueue& queue, const std::vector<cl::Event>& events)
+                            { return image.CopyFrom(data, queue, events); });
+    }
+
+    template <typename T>
+    OperationId Download(GpuBuffer<T>& buffer, std::span<T> data)
+    {
+        return AddOperation("Download", Stream::kDownload, {GpuRead(buffer)},
+                            [&buffer, data](const cl::CommandQueue& queue, const std::vector<cl::Event>& events)
+                            {
+                                std::span<T> _data = data;
+                                return buffer.CopyTo(_data, queue, events);
+                            });
+    }
+
+    template <typename T>
+    OperationId Download(GpuImage<T>& image, gls::image<T>& data)
+    {
+        return AddOperation("Download", Stream::kDownload, {GpuRead(image)},
+                            [&image, &data](const cl::CommandQueue& queue, const std::vector<cl::Event>& events)
+                            { return image.CopyTo(data, queue, events); });
+    }
+
+    /// Issue all the operations, returns the events of the ones no other operation depends on.
+    std::vector<cl::Event> Execute();
+
+    /// Wait for all the queues to be idle.
+    void Finish();
+
+    /// The operations that operation explicitly waits on in the first frame, implied dependencies excluded.
+    const std::vector<OperationId>& Dependencies(OperationId operation);
+
+    /// Event of the latest execution of operation.
+    cl::Event Event(OperationId operation) const { return operations_[operation].event; }
+
+    const cl::CommandQueue& Queue(Stream stream) const { return queues_[QueueIndex(stream)]; }
+
+    /// The allocation and byte range backing memory, following images and sub-buffers to their parent buffer.
+    static MemoryRange ResolveMemory(const cl::Memory& memory);
+
+   private:
+    static constexpr size_t kHostQueue = -1;
+
+    struct Operation
+    {
+        std::string name;
+        size_t queue;
+        std::vector<MemoryRange> reads, writes;
+        Enqueue enqueue;
+
+        // Set by Plan()
+        std::vector<OperationId> waits;        // On operations of the same frame
+        std::vector<OperationId> frame_waits;  // On later operations of the previous frame
+        bool is_sink = true;
+
+        cl::Event event;
+    };
+
+    size_t QueueIndex(Stream stream) const
+    {
+        return stream == Stream::kHost ? kHostQueue : std::min((size_t)stream, queues_.size() - 1);
+    }
+
+    static bool Conflicts(const Operation& a, const Operation& b);
+
+    /// Compute the waits of all the operations, called by Execute() after operations were added.
+    void Plan();
+
+    std::shared_ptr<gls::OCLContext> gpu_context_;
+    std::vector<cl::CommandQueue> queues_;
+    bool in_order_;
+    std::vector<Operation> operations_;
+    bool planned_ = false;
+};
+
+}  // namespace gls
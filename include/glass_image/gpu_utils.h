@@ -1,3 +1,5 @@
+#pragma once
+
 #include <array>
 
 #include "gls_image.hpp"
@@ -37,6 +39,23 @@ cl::ImageFormat GetClFormat()
         throw std::runtime_error("Unsupported pixel type for GpuImage::GetClFormat()");
 }
 
+/// Get the memory pool key of the buffer backing a buffer based image. Images are keyed by shape and format so that a
+/// recycled buffer comes with an image that can be recycled as well.
+/// @param row_pitch Row pitch in pixels
+/// @return Memory pool key of the image buffer
+template <typename T>
+OCLMemoryPool::Key GetImagePoolKey(size_t row_pitch, size_t width, size_t height, size_t depth, cl_mem_flags flags)
+{
+    const cl::ImageFormat format = GetClFormat<T>();
+    return OCLMemoryPool::Key{.bytes = sizeof(T) * row_pitch * height * depth,
+                              .flags = flags,
+                              .order = format.image_channel_order,
+                              .type = format.image_channel_data_type,
+                              .width = width,
+                              .height = height,
+                              .depth = depth};
+}
+
 /// Get the optimal row pitch for an image with the given width in pixels, adhering to the device constraints and
 /// potentially padded to a non-power of 2.
 /// @param width Width in pixels
@@ -15,6 +15,8 @@
 
 #include <cmath>
 #include <map>
+#include <string>
+#include <vector>
 
 #ifndef GLS_CL_HPP
 #define GLS_CL_HPP
@@ -112,5 +114,20 @@ class OpenCLContext {
 
 std::string clStatusToString(cl_int status);
 
+// Persistent program binary cache: programs built from source with buildProgramWithCache are saved to the cache
+// directory, keyed by device name, driver version, build options, a hash of the sources and a version salt, and later
+// builds load the saved binary instead of compiling again.
+// Sources pulled in with #include are not hashed: versionSalt has to change with them, e.g.: a hash of the shader
+// headers or the build's version string.
+// The cache is opt-in: it is disabled unless a directory is set here or with $GLS_OPENCL_CACHE_DIR (and the salt with
+// $GLS_OPENCL_CACHE_SALT). An empty path disables the cache.
+void setProgramCacheDirectory(const std::string& path, const std::string& versionSalt = "");
+
+std::string programCacheDirectory();
+
+// Build sources for device, throws cl::BuildError like cl::Program::build
+cl::Program buildProgramWithCache(const cl::Context& context, const cl::Device& device,
+                                  const std::vector<std::string>& sources, const std::string& options);
+
 }  // namespace gls
 #endif /* GLS_CL_HPP */
@@ -16,6 +16,8 @@
 #include <span>
 #include <vector>
 
+#include "gls_image.hpp"
+
 #if defined(__linux__) && !defined(__ANDROID__)
 #include <stdint.h>
 
@@ -67,6 +69,10 @@ class dng_stream {
     }
 
     size_t Position() const { return _position; }
+
+    uint8_t* Data() const { return _buffer.data(); }
+
+    size_t Length() const { return _buffer.size(); }
 };
 
 class dng_spooler {
@@ -83,10 +89,46 @@ class dng_spooler {
     size_t size() { return _storage.size(); }
 };
 
-void DecodeLosslessJPEG(dng_stream& stream, dng_spooler& spooler, uint32_t minDecodedSize, uint32_t maxDecodedSize,
-                        bool bug16, uint64_t endOfData);
+// Strided destination for decoding lossless JPEG data in place. The decoded samples are seen as rows of rowSamples
+// samples (the JPEG row width when zero), sample (x, y) is stored at data[(y - offsetY) * rowStep + x - offsetX],
+// samples falling outside of the width x height destination window are dropped.
+struct dng_decode_destination {
+    uint16_t* data;
+    size_t rowStep;       // Distance between destination rows, in samples
+    uint32_t width;       // Destination width, in samples
+    uint32_t height;      // Destination height, in rows
+    uint32_t rowSamples;  // Decoded row width, in samples, 0 = JPEG image width
+    int32_t offsetX;      // Position of the destination window in the decoded data
+    int32_t offsetY;
+};
 
+// When threads > 1 and the scan has restart markers (DRI), the restart intervals are decoded concurrently.
+// Huffman codes are decoded with lookup tables, useLookupTables = false selects the reference bit by bit decoder.
+void DecodeLosslessJPEG(dng_stream& stream, dng_spooler& spooler, uint32_t minDecodedSize, uint32_t maxDecodedSize,
+                        bool bug16, uint64_t endOfData, int threads = 1, bool useLookupTables = true);
+
+// Decode directly into the destination, without intermediate buffers
+void DecodeLosslessJPEG(dng_stream& stream, const dng_decode_destination& destination, bool bug16, uint64_t endOfData,
+                        int threads = 1);
+
+// Decode into a 16 bit image, the JPEG rows are expected to hold image->width * T::channels samples
+template <typename T>
+requires(sizeof(typename T::value_type) == sizeof(uint16_t))
+void DecodeLosslessJPEG(dng_stream& stream, image<T>* destination, bool bug16, uint64_t endOfData, int threads = 1) {
+    DecodeLosslessJPEG(stream,
+                       {.data = (uint16_t*)(*destination)[0],
+                        .rowStep = (size_t)destination->stride * T::channels,
+                        .width = (uint32_t)(destination->width * T::channels),
+                        .height = (uint32_t)destination->height,
+                        .rowSamples = 0,
+                        .offsetX = 0,
+                        .offsetY = 0},
+                       bug16, endOfData, threads);
+}
+
+// With restartRows > 0 a restart marker is emitted every restartRows rows, allowing parallel decoding
 void EncodeLosslessJPEG(const uint16_t* srcData, uint32_t srcRows, uint32_t srcCols, uint32_t srcChannels,
-                        uint32_t srcBitDepth, int32_t srcRowStep, int32_t srcColStep, dng_stream& stream);
+                        uint32_t srcBitDepth, int32_t srcRowStep, int32_t srcColStep, dng_stream& stream,
+                        uint32_t restartRows = 0);
 
 }  // namespace gls
@@ -220,12 +220,10 @@ DECLARE_TYPE_FORMATS(int32_t, SIGNED_INT32)
 
 template <typename T>
 struct mapped_image : public image<T> {
-    std::function<void(void* ptr)> _cleanup;
-
+    // The mapping is released by the storage owner, when the last image referencing it goes away: a mapped_image can
+    // be moved into a plain gls::image
     mapped_image(int _width, int _height, int _stride, std::span<T> data, std::function<void(void* ptr)> cleanup)
-        : image<T>(_width, _height, _stride, data), _cleanup(cleanup) {}
-
-    ~mapped_image() { _cleanup((*this)[0]); }
+        : image<T>(_width, _height, _stride, data, std::shared_ptr<void>(data.data(), cleanup)) {}
 };
 
 template <typename T>
@@ -266,6 +264,13 @@ class gpu_image : public basic_image<T>, public virtual texture {
         }
     }
 
+    // Parallel apply(), see image::parallel_for_each_pixel()
+    template <typename Process>
+    void parallel_for_each_pixel(Process&& process, int max_threads = 0) {
+        auto cpu_image = mapImage();
+        cpu_image.parallel_for_each_pixel(std::forward<Process>(process), max_threads);
+    }
+
     typename gls::image<T> mapImage() const {
         auto mappedTexture = _texture->mapTexture();
 
@@ -378,7 +383,7 @@ class Kernel {
     }
 
    public:
-    Kernel(GpuContext* context, const std::string& kernelName) : _kernelName(kernelName) {
+    Kernel(GpuContext*, const std::string& kernelName) : _kernelName(kernelName) {
         // auto pipelineState = context->getPipelineState(kernelName);
     }
 
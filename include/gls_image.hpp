@@ -24,12 +24,22 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <numeric>
 #include <span>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 #include "gls_geometry.hpp"
+#include "gls_parallel.hpp"
+#include "gls_raw_unpack.hpp"
 #ifdef GLASS_IMAGE_BUILD_IMAGE_IO
 #include "gls_image_jpeg.h"
 #include "gls_image_png.h"
@@ -248,8 +258,10 @@ template <typename T>
 class basic_image
 {
    public:
-    const int width;
-    const int height;
+    // Read-only: public for convenience, only the move operations of gls::image assign them, keeping the shape in
+    // sync with the pixel storage
+    int width;
+    int height;
 
     constexpr gls::size size() const { return {width, height}; }
 
@@ -277,56 +289,193 @@ struct has_channels<T, std::void_t<decltype(T::channels)>> : std::true_type
 // std::vector is convenient but it is expensive as it initializes memory
 #define USE_STD_VECTOR_ALLOCATION false
 
+// Allocation policy of the pixel storage of owning images, see image(width, height, allocation)
+struct image_allocation
+{
+    // Alignment of the storage and, with pad_stride, of every row: 64 bytes is a cache line and the widest SIMD load
+    size_t alignment = 64;
+    // Round rows up to the alignment and avoid strides which are a multiple of 4KB: with those, the same column of
+    // consecutive rows maps to the same cache set, e.g.: for power of two widths
+    bool pad_stride = false;
+    // On Linux, back allocations of 2MB or more with transparent huge pages to reduce TLB misses on large frames
+    bool huge_pages = false;
+
+    static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+    static constexpr size_t cache_aliasing_stride = 4096;
+
+    // Row stride, in pixels, of an image of the given width
+    template <typename T>
+    constexpr int stride(int width) const
+    {
+        if (!pad_stride)
+        {
+            return width;
+        }
+        const size_t unit = std::lcm(alignment, sizeof(T)) / sizeof(T);
+        size_t stride = (width + unit - 1) / unit * unit;
+        if ((stride * sizeof(T)) % cache_aliasing_stride == 0)
+        {
+            stride += unit;
+        }
+        return (int)stride;
+    }
+
+    // Alignment of an allocation of the given size
+    template <typename T>
+    constexpr size_t storage_alignment(size_t bytes) const
+    {
+        const size_t storage_alignment = std::max(alignment, alignof(T));
+        return huge_pages && bytes >= huge_page_size ? std::max(storage_alignment, huge_page_size) : storage_alignment;
+    }
+
+    // Default initialized storage for count pixels, release it with deallocate()
+    template <typename T>
+    T* allocate(size_t count) const
+    {
+        const size_t bytes = count * sizeof(T);
+        const size_t storage_alignment = this->storage_alignment<T>(bytes);
+        T* pixels = static_cast<T*>(::operator new(bytes, std::align_val_t(storage_alignment)));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (storage_alignment >= huge_page_size)
+        {
+            // Only a hint, the kernel falls back to regular pages
+            madvise(pixels, (bytes + huge_page_size - 1) / huge_page_size * huge_page_size, MADV_HUGEPAGE);
+        }
+#endif
+        std::uninitialized_default_construct_n(pixels, count);
+        return pixels;
+    }
+
+    template <typename T>
+    static void deallocate(T* pixels, size_t count, size_t storage_alignment)
+    {
+        std::destroy_n(pixels, count);
+        ::operator delete(pixels, std::align_val_t(storage_alignment));
+    }
+};
+
 template <typename T>
 class image : public basic_image<T>
 {
    public:
-    const int stride;
+    // Read-only, as width and height
+    int stride;
     typedef std::unique_ptr<image<T>> unique_ptr;
 
    protected:
+    // Retains the pixels: owned by the image, shared with its views or held by a caller provided owner. Null for
+    // images wrapping memory owned by the caller.
+    std::shared_ptr<void> _storage;
+    std::span<T> _data;
+
+    static std::shared_ptr<T> allocate_storage(size_t count, const image_allocation& allocation)
+    {
 #if USE_STD_VECTOR_ALLOCATION
-    const std::unique_ptr<std::vector<T>> _data_store = nullptr;
+        auto store = std::make_shared<std::vector<T>>(count);
+        return std::shared_ptr<T>(store, store->data());
 #else
-    T* _data_store = nullptr;
+        const size_t alignment = allocation.storage_alignment<T>(count * sizeof(T));
+        return std::shared_ptr<T>(allocation.allocate<T>(count), [count, alignment](T* pixels)
+                                  { image_allocation::deallocate(pixels, count, alignment); });
 #endif
-    const std::span<T> _data;
+    }
+
+    // Run row(y) for all the rows, see gls::parallel_rows()
+    template <typename Row>
+    void for_each_row_block(int max_threads, Row&& row) const
+    {
+        parallel_rows(*this, std::forward<Row>(row), max_threads);
+    }
+
+    template <typename Process, typename Pixel>
+    static void for_each_pixel_in_row(Process& process, std::span<Pixel> row, int y)
+    {
+        const int width = (int)row.size();
+        if constexpr (std::is_invocable_v<Process&, Pixel*, int, int>)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                process(&row[x], x, y);
+            }
+        }
+        else if constexpr (std::is_invocable_v<Process&, Pixel&, int, int>)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                process(row[x], x, y);
+            }
+        }
+        else
+        {
+            for (int x = 0; x < width; x++)
+            {
+                process(row[x]);
+            }
+        }
+    }
 
    public:
-    // Data is owned by the image and retained by _data_store
-    constexpr image(int _width, int _height, int _stride)
+    // Data is owned by the image and retained by _storage. The storage is aligned as specified by allocation, with
+    // USE_STD_VECTOR_ALLOCATION it only has the alignment of std::vector
+    constexpr image(int _width, int _height, int _stride, const image_allocation& allocation = {})
         : basic_image<T>(_width, _height),
           stride(_stride),
-#if USE_STD_VECTOR_ALLOCATION
-          _data_store(std::make_unique<std::vector<T>>(_stride * _height)),
-          _data(_data_store->data(), _data_store->size())
+          _storage(allocate_storage((size_t)_stride * _height, allocation)),
+          _data(static_cast<T*>(_storage.get()), (size_t)_stride * _height)
     {
     }
-#else
-          _data_store(new T[_stride * _height]),
-          _data(_data_store, _stride * _height)
+
+    virtual ~image() = default;
+
+    // Images are never copied implicitly, see clone(). Moves transfer the storage and leave an empty image behind.
+    image(const image&) = delete;
+    image& operator=(const image&) = delete;
+
+    image(image&& other) noexcept
+        : basic_image<T>(std::exchange(other.width, 0), std::exchange(other.height, 0)),
+          stride(std::exchange(other.stride, 0)),
+          _storage(std::move(other._storage)),
+          _data(std::exchange(other._data, {}))
     {
     }
 
-    virtual ~image() { delete _data_store; }
-#endif
+    image& operator=(image&& other) noexcept
+    {
+        if (this != &other)
+        {
+            basic_image<T>::width = std::exchange(other.width, 0);
+            basic_image<T>::height = std::exchange(other.height, 0);
+            stride = std::exchange(other.stride, 0);
+            _storage = std::move(other._storage);
+            _data = std::exchange(other._data, {});
+        }
+        return *this;
+    }
 
     constexpr image(int _width, int _height) : image(_width, _height, _width) {}
 
+    // The stride is chosen by allocation, e.g.: padded rows with image_allocation{.pad_stride = true}
+    constexpr image(int _width, int _height, const image_allocation& allocation)
+        : image(_width, _height, allocation.stride<T>(_width), allocation)
+    {
+    }
+
     constexpr image(size _dimensions) : image(_dimensions.width, _dimensions.height) {}
 
-    // Data is owned by caller, the image is only a wrapper around it
-    constexpr image(int _width, int _height, int _stride, std::span<T> data)
-        : basic_image<T>(_width, _height), stride(_stride), _data(data)
+    // Data is owned by caller, the image is only a wrapper around it. A storage owner can be passed to keep the data
+    // alive as long as the image or any of its views, e.g.: with a deleter unmapping it
+    constexpr image(int _width, int _height, int _stride, std::span<T> data, std::shared_ptr<void> storage = nullptr)
+        : basic_image<T>(_width, _height), stride(_stride), _storage(std::move(storage)), _data(data)
     {
-        assert(_stride * _height <= data.size());
+        assert((size_t)_stride * _height <= data.size());
     }
 
     constexpr image(int _width, int _height, std::span<T> data) : image<T>(_width, _height, _width, data) {}
 
+    // Views on a region of _base, they share its storage and keep it alive
     constexpr image(image* _base, int _x, int _y, int _width, int _height)
         : image<T>(_width, _height, _base->stride,
-                   std::span(_base->_data.data() + _y * _base->stride + _x, _base->stride * _height))
+                   std::span(_base->_data.data() + _y * _base->stride + _x, _base->stride * _height), _base->_storage)
     {
         assert(_x + _width <= _base->width && _y + _height <= _base->height);
     }
@@ -335,7 +484,7 @@ class image : public basic_image<T>
 
     constexpr image(const image& _base, int _x, int _y, int _width, int _height)
         : image<T>(_width, _height, _base.stride,
-                   std::span(_base._data.data() + _y * _base.stride + _x, _base.stride * _height))
+                   std::span(_base._data.data() + _y * _base.stride + _x, _base.stride * _height), _base._storage)
     {
         assert(_x + _width <= _base.width && _y + _height <= _base.height);
     }
@@ -345,6 +494,20 @@ class image : public basic_image<T>
     {
     }
 
+    // Deep copy of the pixels into a new, owning image
+    image clone() const
+    {
+        image copy(basic_image<T>::width, basic_image<T>::height);
+        for (int y = 0; y < basic_image<T>::height; y++)
+        {
+            std::copy((*this)[y], (*this)[y] + basic_image<T>::width, copy[y]);
+        }
+        return copy;
+    }
+
+    // Owner of the pixels, shared by the image and its views. Null if the pixels are owned by the caller.
+    const std::shared_ptr<void>& storage() const { return _storage; }
+
     // row access
     constexpr T* operator[](int row) { return &_data[stride * row]; }
 
@@ -406,6 +569,41 @@ class image : public basic_image<T>
         }
     }
 
+    // Parallel iteration: unlike apply(), process can be any callable and is inlined, the rows are split across up to
+    // max_threads threads (0 means all hardware threads), so process must be safe to call concurrently. Row blocks are
+    // handed out dynamically, small images are processed on the calling thread.
+
+    // Run process(span, y) for every row, process is handed the row's width pixels, a tight loop over the span lets
+    // the compiler vectorize it
+    template <typename Process>
+    void parallel_for_each_row(Process&& process, int max_threads = 0)
+    {
+        for_each_row_block(max_threads,
+                           [&](int y) { process(std::span<T>(&_data[stride * y], basic_image<T>::width), y); });
+    }
+
+    template <typename Process>
+    void parallel_for_each_row(Process&& process, int max_threads = 0) const
+    {
+        for_each_row_block(max_threads,
+                           [&](int y) { process(std::span<const T>(&_data[stride * y], basic_image<T>::width), y); });
+    }
+
+    // Run process for every pixel, with any of the signatures of apply(): process(pixel), process(pixel, x, y) with
+    // the pixel by reference, or process(T* pixel, x, y)
+    template <typename Process>
+    void parallel_for_each_pixel(Process&& process, int max_threads = 0)
+    {
+        parallel_for_each_row([&](std::span<T> row, int y) { for_each_pixel_in_row(process, row, y); }, max_threads);
+    }
+
+    template <typename Process>
+    void parallel_for_each_pixel(Process&& process, int max_threads = 0) const
+    {
+        parallel_for_each_row([&](std::span<const T> row, int y) { for_each_pixel_in_row(process, row, y); },
+                              max_threads);
+    }
+
     const constexpr size_t size_in_bytes() const { return _data.size() * basic_image<T>::pixel_size; }
 
 #ifdef GLASS_IMAGE_BUILD_IMAGE_IO
@@ -581,59 +779,157 @@ class image : public basic_image<T>
         file.close();
     }
 
-    // Helper function for read_tiff_file and read_dng_file
-    constexpr static bool process_tiff_strip(image* destination, int tiff_bitspersample, int tiff_samplesperpixel,
-                                             int destination_row, int strip_width, int strip_height, int crop_x,
-                                             int crop_y, uint8_t* tiff_buffer)
+    // Sample conversions from TIFF strip data to value_type
+    enum class tiff_conversion
+    {
+        same,      // Same bit depth
+        widen_8,   // 8 bits to 16 bits
+        narrow_16  // 16 bits to 8 bits
+    };
+
+    template <typename S, tiff_conversion conversion>
+    constexpr static auto convert_tiff_sample(S sample)
     {
         typedef typename T::value_type value_type;
 
-        std::function<value_type()> nextTiffPixelSame = [&tiff_buffer]() -> value_type
+        if constexpr (conversion == tiff_conversion::widen_8)
         {
-            value_type pixelValue = *((value_type*)tiff_buffer);
-            tiff_buffer += sizeof(value_type);
-            return pixelValue;
-        };
-        std::function<value_type()> nextTiffPixel8to16 = [&tiff_buffer]() -> value_type
+            return (value_type)(sample << 8);
+        }
+        else if constexpr (conversion == tiff_conversion::narrow_16)
         {
-            return (value_type) * (tiff_buffer++) << 8;
-            ;
-        };
-        std::function<value_type()> nextTiffPixel16to8 = [&tiff_buffer]() -> value_type
+            return (value_type)(sample >> 8);
+        }
+        else
         {
-            value_type pixelValue = (value_type)(*((uint16_t*)tiff_buffer) >> 8);
-            tiff_buffer += sizeof(uint16_t);
-            return pixelValue;
-        };
+            return (value_type)sample;
+        }
+    }
 
-        auto nextTiffPixel = tiff_bitspersample == T::bit_depth ? nextTiffPixelSame
-                             : (tiff_bitspersample == 8)        ? nextTiffPixel8to16
-                                                                : nextTiffPixel16to8;
+    // Convert a run of pixels of a TIFF strip row. SourceChannels is the number of samples per source pixel, zero when
+    // only known at runtime. When the channel counts match the run is converted as one flat array of samples, which
+    // the compiler turns into vector copies and shifts.
+    template <typename S, tiff_conversion conversion, int SourceChannels>
+    static void convert_tiff_row(T* destination, const S* source, int pixels, int source_channels)
+    {
+        typedef typename T::value_type value_type;
 
-        for (int y = 0; y < strip_height && y + destination_row - crop_y < destination->height; y++)
+        if constexpr (SourceChannels == T::channels)
+        {
+            value_type* out = (value_type*)destination;
+            const int samples = pixels * T::channels;
+            if constexpr (conversion == tiff_conversion::same)
+            {
+                std::copy_n(source, samples, out);
+            }
+            else
+            {
+                for (int i = 0; i < samples; i++)
+                {
+                    out[i] = convert_tiff_sample<S, conversion>(source[i]);
+                }
+            }
+        }
+        else
         {
-            for (int x = 0; x < strip_width; x++)
+            const int step = SourceChannels > 0 ? SourceChannels : source_channels;
+            const int copied = std::min(step, (int)T::channels);
+            for (int x = 0; x < pixels; x++)
             {
-                for (int c = 0; c < std::min((int)tiff_samplesperpixel, (int)T::channels); c++)
+                for (int c = 0; c < copied; c++)
                 {
-                    if (x >= crop_x && y + destination_row >= crop_y && x - crop_x < destination->width)
-                    {
-                        (*destination)[y + destination_row - crop_y][x - crop_x][c] = nextTiffPixel();
-                    }
-                    else
-                    {
-                        nextTiffPixel();
-                    }
+                    destination[x][c] = convert_tiff_sample<S, conversion>(source[x * step + c]);
                 }
             }
         }
+    }
+
+    template <typename S, tiff_conversion conversion, int SourceChannels>
+    static void convert_tiff_rows(image* destination, int destination_x, int destination_y, const S* source,
+                                  size_t source_row_step, int source_channels, int pixels, int rows)
+    {
+        for (int y = 0; y < rows; y++)
+        {
+            convert_tiff_row<S, conversion, SourceChannels>(&(*destination)[destination_y + y][destination_x],
+                                                            source + y * source_row_step, pixels, source_channels);
+        }
+    }
+
+    template <typename S, tiff_conversion conversion>
+    static void convert_tiff_rows(image* destination, int destination_x, int destination_y, const S* source,
+                                  size_t source_row_step, int source_channels, int pixels, int rows)
+    {
+        switch (source_channels)
+        {
+            case 1:
+                convert_tiff_rows<S, conversion, 1>(destination, destination_x, destination_y, source, source_row_step,
+                                                    source_channels, pixels, rows);
+                break;
+            case 2:
+                convert_tiff_rows<S, conversion, 2>(destination, destination_x, destination_y, source, source_row_step,
+                                                    source_channels, pixels, rows);
+                break;
+            case 3:
+                convert_tiff_rows<S, conversion, 3>(destination, destination_x, destination_y, source, source_row_step,
+                                                    source_channels, pixels, rows);
+                break;
+            case 4:
+                convert_tiff_rows<S, conversion, 4>(destination, destination_x, destination_y, source, source_row_step,
+                                                    source_channels, pixels, rows);
+                break;
+            default:
+                convert_tiff_rows<S, conversion, 0>(destination, destination_x, destination_y, source, source_row_step,
+                                                    source_channels, pixels, rows);
+        }
+    }
+
+    // Helper function for read_tiff_file and read_dng_file
+    constexpr static bool process_tiff_strip(image* destination, int tiff_bitspersample, int tiff_samplesperpixel,
+                                             int destination_row, int strip_width, int strip_height, int crop_x,
+                                             int crop_y, uint8_t* tiff_buffer)
+    {
+        typedef typename T::value_type value_type;
+
+        // The part of the strip which lands in the destination image
+        const int y0 = std::max(0, crop_y - destination_row);
+        const int y1 = std::min(strip_height, destination->height + crop_y - destination_row);
+        const int x0 = std::max(0, crop_x);
+        const int x1 = std::min(strip_width, destination->width + crop_x);
+        if (y1 <= y0 || x1 <= x0)
+        {
+            return true;
+        }
+
+        const size_t row_step = (size_t)strip_width * tiff_samplesperpixel;
+        const size_t offset = y0 * row_step + x0 * tiff_samplesperpixel;
+        const int destination_x = x0 - crop_x;
+        const int destination_y = y0 + destination_row - crop_y;
+
+        if (tiff_bitspersample == T::bit_depth)
+        {
+            convert_tiff_rows<value_type, tiff_conversion::same>(destination, destination_x, destination_y,
+                                                                 (const value_type*)tiff_buffer + offset, row_step,
+                                                                 tiff_samplesperpixel, x1 - x0, y1 - y0);
+        }
+        else if (tiff_bitspersample == 8)
+        {
+            convert_tiff_rows<uint8_t, tiff_conversion::widen_8>(destination, destination_x, destination_y,
+                                                                 tiff_buffer + offset, row_step, tiff_samplesperpixel,
+                                                                 x1 - x0, y1 - y0);
+        }
+        else
+        {
+            convert_tiff_rows<uint16_t, tiff_conversion::narrow_16>(destination, destination_x, destination_y,
+                                                                    (const uint16_t*)tiff_buffer + offset, row_step,
+                                                                    tiff_samplesperpixel, x1 - x0, y1 - y0);
+        }
         return true;
     };
 
-    // Image factory from TIFF file
+    // Image factory from TIFF file, when roi is set only that region of the image is read
     constexpr static unique_ptr read_tiff_file(const std::string& filename,
                                                std::function<unique_ptr(int width, int height)> image_allocator,
-                                               tiff_metadata* metadata = nullptr)
+                                               tiff_metadata* metadata = nullptr, const rectangle* roi = nullptr)
     {
         unique_ptr image = nullptr;
         gls::read_tiff_file(
@@ -643,17 +939,19 @@ class image : public basic_image<T>
                      int crop_x, int crop_y, uint8_t* tiff_buffer) -> bool
             {
                 return process_tiff_strip(image.get(), tiff_bitspersample, tiff_samplesperpixel, row,
-                                          /*strip_width=*/image->width, strip_height,
-                                          /*crop_x=*/0, /*crop_y=*/0, tiff_buffer);
-            });
+                                          /*strip_width=*/strip_width, strip_height,
+                                          /*crop_x=*/crop_x, /*crop_y=*/crop_y, tiff_buffer);
+            },
+            roi);
         return image;
     }
 
-    constexpr static unique_ptr read_tiff_file(const std::string& filename, tiff_metadata* metadata = nullptr)
+    constexpr static unique_ptr read_tiff_file(const std::string& filename, tiff_metadata* metadata = nullptr,
+                                               const rectangle* roi = nullptr)
     {
         return read_tiff_file(
             filename, [](int width, int height) -> unique_ptr
-            { return std::make_unique<gls::image<T>>(width, height); }, metadata);
+            { return std::make_unique<gls::image<T>>(width, height); }, metadata, roi);
     }
 
     // Write image to TIFF file
@@ -667,11 +965,11 @@ class image : public basic_image<T>
                                          T::bit_depth, compression, metadata, icc_profile_data, row_pointer);
     }
 
-    // Image factory from DNG file
+    // Image factory from DNG file, when roi is set only that region of the (default cropped) image is decoded
     constexpr static unique_ptr read_dng_file(const std::string& filename,
                                               std::function<unique_ptr(int width, int height)> image_allocator,
                                               tiff_metadata* dng_metadata = nullptr,
-                                              tiff_metadata* exif_metadata = nullptr)
+                                              tiff_metadata* exif_metadata = nullptr, const rectangle* roi = nullptr)
     {
         unique_ptr image = nullptr;
         gls::read_dng_file(
@@ -684,27 +982,38 @@ class image : public basic_image<T>
                 return process_tiff_strip(image.get(), tiff_bitspersample, tiff_samplesperpixel, row,
                                           /*strip_width=*/strip_width, strip_height,
                                           /*crop_x=*/crop_x, /*crop_y=*/crop_y, tiff_buffer);
-            });
+            },
+            // Let the lossless JPEG decoder write 16 bit images in place
+            [&image](size_t* row_step) -> uint16_t*
+            {
+                if constexpr (T::bit_depth == 16)
+                {
+                    *row_step = image->stride * T::channels;
+                    return (uint16_t*)(*image)[0];
+                }
+                return nullptr;
+            },
+            roi);
         return image;
     }
 
     constexpr static unique_ptr read_dng_file(const std::string& filename, tiff_metadata* dng_metadata = nullptr,
-                                              tiff_metadata* exif_metadata = nullptr)
+                                              tiff_metadata* exif_metadata = nullptr, const rectangle* roi = nullptr)
     {
         return read_dng_file(
             filename, [](int width, int height) -> unique_ptr
-            { return std::make_unique<gls::image<T>>(width, height); }, dng_metadata, exif_metadata);
+            { return std::make_unique<gls::image<T>>(width, height); }, dng_metadata, exif_metadata, roi);
     }
 
-    // Write image to DNG file
+    // Write image to DNG file, lossless JPEG data is tiled when tile_size > 0
     constexpr void write_dng_file(const std::string& filename, tiff_compression compression = tiff_compression::NONE,
                                   const tiff_metadata* dng_metadata = nullptr,
-                                  const tiff_metadata* exif_metadata = nullptr) const
+                                  const tiff_metadata* exif_metadata = nullptr, int tile_size = 0) const
     {
         typedef typename T::value_type value_type;
         auto row_pointer = [this](int row) -> value_type* { return (value_type*)(*this)[row]; };
         gls::write_dng_file(filename, basic_image<T>::width, basic_image<T>::height, T::channels, T::bit_depth,
-                            compression, dng_metadata, exif_metadata, row_pointer);
+                            compression, dng_metadata, exif_metadata, row_pointer, tile_size);
     }
 
     static unique_ptr read_raw_dump(const std::string& filename, const int width, const int height,
@@ -727,6 +1036,35 @@ class image : public basic_image<T>
         return image;
     }
 
+    // Read a dump of packed sensor data, rows are row_bytes apart (packed back to back when zero)
+    static unique_ptr read_raw_dump(const std::string& filename, const int width, const int height,
+                                    raw_packing packing, size_t row_bytes = 0)
+    {
+        std::cout << "Reading raw dump file: " << filename << std::endl;
+
+        const size_t packed_row_bytes = packed_raw_size(packing, width);
+        if (row_bytes == 0)
+        {
+            row_bytes = packed_row_bytes;
+        }
+        std::vector<uint8_t> packed(row_bytes * (height - 1) + packed_row_bytes);
+
+        std::ifstream file(filename, std::ios::binary);
+        if (!file || !file.read((char*)packed.data(), packed.size()))
+        {
+            std::cout << "Cannot read the image file: " << filename << std::endl;
+            return nullptr;
+        }
+        file.close();
+
+        auto image = std::make_unique<gls::image<gls::luma_pixel_16>>(width, height);
+        for (int y = 0; y < height; y++)
+        {
+            unpack_raw(packing, packed.data() + y * row_bytes, (uint16_t*)(*image)[y], width);
+        }
+        return image;
+    }
+
     constexpr void drawCircle(int x, int y, int radius, const T& color)
     {
         for (int i = -radius; i <= radius; i++)
@@ -808,14 +1146,15 @@ class image : public basic_image<T>
     // Image factory from TIFF file
     constexpr static unique_ptr read_tiff_file(const std::string& filename,
                                                std::function<unique_ptr(int width, int height)> image_allocator,
-                                               tiff_metadata* metadata = nullptr)
+                                               tiff_metadata* metadata = nullptr, const rectangle* roi = nullptr)
     {
         assert(false &&
                "Image IO only enabled with GLASS_IMAGE_BUILD_IMAGE_IO flag. Please enable it to use this function.");
         return nullptr;
     }
 
-    constexpr static unique_ptr read_tiff_file(const std::string& filename, tiff_metadata* metadata = nullptr)
+    constexpr static unique_ptr read_tiff_file(const std::string& filename, tiff_metadata* metadata = nullptr,
+                                               const rectangle* roi = nullptr)
     {
         assert(false &&
                "Image IO only enabled with GLASS_IMAGE_BUILD_IMAGE_IO flag. Please enable it to use this function.");
@@ -833,7 +1172,7 @@ class image : public basic_image<T>
     constexpr static unique_ptr read_dng_file(const std::string& filename,
                                               std::function<unique_ptr(int width, int height)> image_allocator,
                                               tiff_metadata* dng_metadata = nullptr,
-                                              tiff_metadata* exif_metadata = nullptr)
+                                              tiff_metadata* exif_metadata = nullptr, const rectangle* roi = nullptr)
     {
         assert(false &&
                "Image IO only enabled with GLASS_IMAGE_BUILD_IMAGE_IO flag. Please enable it to use this function.");
@@ -841,7 +1180,7 @@ class image : public basic_image<T>
     }
 
     constexpr static unique_ptr read_dng_file(const std::string& filename, tiff_metadata* dng_metadata = nullptr,
-                                              tiff_metadata* exif_metadata = nullptr)
+                                              tiff_metadata* exif_metadata = nullptr, const rectangle* roi = nullptr)
     {
         assert(false &&
                "Image IO only enabled with GLASS_IMAGE_BUILD_IMAGE_IO flag. Please enable it to use this function.");
@@ -852,7 +1191,7 @@ class image : public basic_image<T>
     // Write image to DNG file
     constexpr void write_dng_file(const std::string& filename, tiff_compression compression = tiff_compression::NONE,
                                   const tiff_metadata* dng_metadata = nullptr,
-                                  const tiff_metadata* exif_metadata = nullptr) const { }
+                                  const tiff_metadata* exif_metadata = nullptr, int tile_size = 0) const { }
                                   */
 
     static unique_ptr read_raw_dump(const std::string& filename, const int width, const int height,
@@ -863,6 +1202,14 @@ class image : public basic_image<T>
         return nullptr;
     }
 
+    static unique_ptr read_raw_dump(const std::string& filename, const int width, const int height,
+                                    raw_packing packing, size_t row_bytes = 0)
+    {
+        assert(false &&
+               "Image IO only enabled with GLASS_IMAGE_BUILD_IMAGE_IO flag. Please enable it to use this function.");
+        return nullptr;
+    }
+
     constexpr void drawCircle(int x, int y, int radius, const T& color)
     {
         assert(false &&
@@ -883,10 +1230,7 @@ constexpr static inline void copyPixels(gls::image<T>* to, const gls::image<T>&
     }
     else
     {
-        for (int j = 0; j < to->height; j++)
-        {
-            memcpy((void*)(*to)[j], (void*)from[j], to->width * sizeof(T));
-        }
+        parallel_rows(from, [&](int j) { memcpy((void*)(*to)[j], (void*)from[j], to->width * sizeof(T)); });
     }
 }
 
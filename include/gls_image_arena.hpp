@@ -0,0 +1,165 @@
+// Copyright (c) 2021-2023 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef gls_image_arena_hpp
+#define gls_image_arena_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "gls_image.hpp"
+
+namespace gls {
+
+// Bump allocator for short lived images, e.g.: the temporaries of a frame. Images are non-owning views on blocks of
+// memory retained by the arena, they are released all together by reset() or at the end of a scope(), which rewind the
+// arena without returning memory to the heap. After the first frames have grown the arena, creating and destroying
+// images costs no allocations and no page faults.
+//
+// Images must not be used after the arena is rewound past them. An arena must only be used by one thread at a time.
+class image_arena {
+    struct block {
+        std::byte* data;
+        size_t size;
+        size_t alignment;
+    };
+
+    const size_t _block_size;
+    const image_allocation _allocation;
+    std::vector<block> _blocks;
+    size_t _current_block = 0;
+    size_t _offset = 0;
+
+    std::byte* allocate(size_t bytes, size_t alignment) {
+        for (; _current_block < _blocks.size(); _current_block++, _offset = 0) {
+            const block& b = _blocks[_current_block];
+            const uintptr_t base = reinterpret_cast<uintptr_t>(b.data);
+            const size_t start = (base + _offset + alignment - 1) / alignment * alignment - base;
+            if (start + bytes <= b.size) {
+                _offset = start + bytes;
+                return b.data + start;
+            }
+        }
+
+        // Out of memory, blocks are only released by the destructor
+        const size_t size = std::max(_block_size, bytes + alignment);
+        _blocks.push_back(
+            {_allocation.allocate<std::byte>(size), size, _allocation.storage_alignment<std::byte>(size)});
+        return allocate(bytes, alignment);
+    }
+
+   public:
+    // Position of the arena, see rewind()
+    struct mark {
+        size_t block = 0;
+        size_t offset = 0;
+    };
+
+    // Releases the images created after the scope, at the end of its lifetime
+    class scope {
+        image_arena* _arena;
+        const mark _mark;
+
+       public:
+        explicit scope(image_arena* arena) : _arena(arena), _mark(arena->position()) {}
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+        ~scope() { _arena->rewind(_mark); }
+
+        template <typename T>
+        gls::image<T> make_image(int width, int height) {
+            return _arena->make_image<T>(width, height);
+        }
+
+        template <typename T>
+        gls::image<T> make_image(gls::size dimensions) {
+            return _arena->make_image<T>(dimensions);
+        }
+    };
+
+    // Memory is allocated in blocks of block_size bytes, or larger for larger images. Images are aligned and their
+    // stride padded as specified by allocation, which can also back large blocks with huge pages.
+    explicit image_arena(size_t block_size = 64 * 1024 * 1024, const image_allocation& allocation = {})
+        : _block_size(block_size), _allocation(allocation) {}
+
+    image_arena(const image_arena&) = delete;
+    image_arena& operator=(const image_arena&) = delete;
+
+    ~image_arena() {
+        for (const auto& b : _blocks) {
+            image_allocation::deallocate(b.data, b.size, b.alignment);
+        }
+    }
+
+    // A non-owning image, valid until the arena is rewound past it
+    template <typename T>
+    gls::image<T> make_image(int width, int height) {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena images are released without destroying their pixels");
+        const int stride = _allocation.stride<T>(width);
+        const size_t count = (size_t)stride * height;
+        const size_t alignment = std::max(_allocation.alignment, alignof(T));
+        T* pixels = reinterpret_cast<T*>(allocate(count * sizeof(T), alignment));
+        std::uninitialized_default_construct_n(pixels, count);
+        return gls::image<T>(width, height, stride, std::span<T>(pixels, count));
+    }
+
+    template <typename T>
+    gls::image<T> make_image(gls::size dimensions) {
+        return make_image<T>(dimensions.width, dimensions.height);
+    }
+
+    mark position() const { return {_current_block, _offset}; }
+
+    // Release the images created after mark was taken
+    void rewind(const mark& m) {
+        _current_block = m.block;
+        _offset = m.offset;
+    }
+
+    // Release all the images, e.g.: at the end of a frame
+    void reset() { rewind({}); }
+
+    // Scope releasing the images it creates at the end of its lifetime
+    scope make_scope() { return scope(this); }
+
+    // Memory retained by the arena
+    size_t capacity() const {
+        size_t size = 0;
+        for (const auto& b : _blocks) {
+            size += b.size;
+        }
+        return size;
+    }
+
+    // Memory used by the live images, alignment padding included
+    size_t used() const {
+        size_t size = _offset;
+        for (size_t i = 0; i < std::min(_current_block, _blocks.size()); i++) {
+            size += _blocks[i].size;
+        }
+        return size;
+    }
+};
+
+}  // namespace gls
+
+#endif /* gls_image_arena_hpp */
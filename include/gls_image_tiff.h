@@ -20,6 +20,8 @@
 #include <span>
 #include <string>
 
+#include "gls_geometry.hpp"
+
 namespace gls {
 
 // clang-format off
@@ -41,21 +43,57 @@ typedef std::function<bool(int tiff_bitspersample, int tiff_samplesperpixel, int
                            int crop_x, int crop_y, uint8_t* tiff_buffer)>
     tiff_strip_procesor;
 
+// Direct access to a 16 bit destination image with pixel_channels channels, lets the lossless JPEG decoder write
+// straight into it. Returns the address of the first sample and sets the row step in samples, or nullptr.
+typedef std::function<uint16_t*(size_t* row_step)> tiff_destination;
+
+// When roi is set only the roi rectangle of the image is read: image_allocator is called with the roi size, the strip
+// processor receives the roi origin as crop offset, and strips which don't intersect the roi are never read.
 void read_tiff_file(const std::string& filename, int pixel_channels, int pixel_bit_depth, tiff_metadata* metadata,
-                    std::function<bool(int width, int height)> image_allocator, tiff_strip_procesor process_tiff_strip);
+                    std::function<bool(int width, int height)> image_allocator, tiff_strip_procesor process_tiff_strip,
+                    const rectangle* roi = nullptr);
 
 template <typename T>
 void write_tiff_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
                      tiff_compression compression, tiff_metadata* metadata, const std::vector<uint8_t>* icc_profile_data,
                      std::function<T*(int row)> row_pointer);
 
+// Tiled lossless JPEG DNG files are decoded one tile per task, in parallel. The process_tiff_strip callback is then
+// invoked concurrently, once per tile, with non-overlapping destination regions. Single strip files with restart
+// markers are decoded in parallel as well, one restart interval per task.
+// The file's strips and tiles are decoded in place from a read only memory mapping of the file whenever possible.
+// The optional roi is relative to the DNG default crop, tiles and strips outside of it are skipped entirely.
+// Set the number of decoding threads, 0 (the default) uses all hardware threads.
+void set_dng_decode_threads(int threads);
+
+int dng_decode_threads();
+
 void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bit_depth, tiff_metadata* dng_metadata,
                    tiff_metadata* exif_metadata, std::function<bool(int width, int height)> image_allocator,
-                   tiff_strip_procesor process_tiff_strip);
+                   tiff_strip_procesor process_tiff_strip, tiff_destination destination = nullptr,
+                   const rectangle* roi = nullptr);
+
+// Lossless JPEG DNG files are written as a single strip, or as tile_size x tile_size tiles (rounded up to a multiple
+// of 16) when tile_size > 0. Tiles are encoded concurrently, row_pointer must be safe to call from multiple threads.
+void set_dng_encode_threads(int threads);
+
+int dng_encode_threads();
 
 void write_dng_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
                     tiff_compression compression, const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata,
-                    std::function<uint16_t*(int row)> row_pointer);
+                    std::function<uint16_t*(int row)> row_pointer, int tile_size = 0);
+
+// Fills rows [row, row + rows) of a streamed DNG image into band, rows are row_step samples apart.
+// Returning false aborts the write.
+typedef std::function<bool(int row, int rows, uint16_t* band, size_t row_step)> dng_band_producer;
+
+// Streaming DNG writer, the image is requested from produce_band in bands of band_size rows, top to bottom, and each
+// band is encoded and written as soon as it is produced. Lossless JPEG data is written as band_size x band_size tiles
+// (rounded up to a multiple of 16), other compression schemes as one strip per band. Only one band is resident at any
+// time, regardless of the image size. produce_band is always called from the calling thread.
+void write_dng_file_streaming(const std::string& filename, int width, int height, tiff_compression compression,
+                              const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata,
+                              dng_band_producer produce_band, int band_size = 256);
 
 }  // namespace gls
 
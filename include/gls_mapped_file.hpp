@@ -0,0 +1,80 @@
+// Copyright (c) 2021-2023 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef gls_mapped_file_hpp
+#define gls_mapped_file_hpp
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+namespace gls {
+
+// Read only memory mapping of a whole file. If the file can't be mapped the mapping is empty and evaluates to false,
+// callers are expected to fall back to regular reads.
+class mapped_file {
+    uint8_t* _data = nullptr;
+    size_t _size = 0;
+
+   public:
+    explicit mapped_file(const std::string& filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                _data = (uint8_t*)data;
+                _size = st.st_size;
+                // The whole file is usually needed, let the kernel read ahead
+                posix_madvise(_data, _size, POSIX_MADV_WILLNEED);
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+    }
+
+    ~mapped_file() {
+        if (_data) {
+            munmap(_data, _size);
+        }
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    explicit operator bool() const { return _data != nullptr; }
+
+    size_t size() const { return _size; }
+
+    // The mapped bytes [offset, offset + count), or nullptr if the range is not entirely inside the file.
+    // The memory is read only, the non const pointer is for the benefit of dng_stream and the strip processors.
+    uint8_t* view(uint64_t offset, uint64_t count) const {
+        if (_data && offset <= _size && count <= _size - offset) {
+            return _data + offset;
+        }
+        return nullptr;
+    }
+};
+
+}  // namespace gls
+
+#endif /* gls_mapped_file_hpp */
@@ -8,11 +8,19 @@
 #ifndef gls_ocl_h
 #define gls_ocl_h
 
+#include <array>
 #include <cmath>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <tuple>
 
 #include "gls_logging.h"
 
@@ -112,12 +120,382 @@ static const char* cl_options = "-cl-std=CL1.2 -cl-single-precision-constant -I
 static const char* cl_options = "-cl-std=CL2.0 -Werror -cl-single-precision-constant -I " OPENCL_HEADERS_PATH "OpenCL";
 #endif
 
+// Recycles device memory between GpuBuffer, GpuImage and GpuImage3d allocations of the same shape. Released blocks go
+// back to a bucket keyed by size, flags and image format, keeping the cl::Image created on the buffer by their first
+// owner, so a steady state frame loop performs no OpenCL allocations at all.
+// Blocks are recycled as soon as their last owner is gone: work still pending on a different command queue must be
+// waited for before releasing its images.
+class OCLMemoryPool
+{
+   public:
+    struct Key
+    {
+        size_t bytes = 0;
+        cl_mem_flags flags = CL_MEM_READ_WRITE;
+        // Image shape and format, all zero for plain buffers
+        cl_channel_order order = 0;
+        cl_channel_type type = 0;
+        size_t width = 0, height = 0, depth = 0;
+
+        bool operator==(const Key& other) const = default;
+    };
+
+    struct Block
+    {
+        const Key key;
+        cl::Buffer buffer;
+        cl::Memory image;  // Created lazily by the first owner, recycled together with the buffer
+    };
+
+    struct Statistics
+    {
+        uint64_t requests = 0;
+        uint64_t hits = 0;
+        size_t bytesHeld = 0;   // Idle in the pool
+        size_t bytesInUse = 0;  // Handed out and not yet released
+        size_t peakBytes = 0;   // High water mark of bytesHeld + bytesInUse
+
+        double hitRate() const { return requests > 0 ? (double)hits / requests : 0; }
+    };
+
+   private:
+    // Shared with the block deleters, blocks can outlive the pool
+    struct State
+    {
+        cl::Context context;
+        size_t maxBytesHeld = 0;
+        std::mutex mutex;
+        std::list<std::unique_ptr<Block>> idle;  // Least recently released first
+        Statistics statistics;
+    };
+    std::shared_ptr<State> _state;
+
+    static void evict(State* state, size_t maxBytesHeld)
+    {
+        while (state->statistics.bytesHeld > maxBytesHeld && !state->idle.empty())
+        {
+            state->statistics.bytesHeld -= state->idle.front()->key.bytes;
+            state->idle.pop_front();
+        }
+    }
+
+    static void recycle(const std::weak_ptr<State>& weakState, Block* block)
+    {
+        std::unique_ptr<Block> owned(block);
+        if (auto state = weakState.lock())
+        {
+            std::lock_guard<std::mutex> guard(state->mutex);
+            state->statistics.bytesInUse -= block->key.bytes;
+            if (block->key.bytes <= state->maxBytesHeld)
+            {
+                state->statistics.bytesHeld += block->key.bytes;
+                state->idle.push_back(std::move(owned));
+                evict(state.get(), state->maxBytesHeld);
+            }
+        }
+    }
+
+   public:
+    OCLMemoryPool(cl::Context context, size_t maxBytesHeld)
+        : _state(std::make_shared<State>())
+    {
+        _state->context = context;
+        _state->maxBytesHeld = maxBytesHeld;
+    }
+
+    OCLMemoryPool(const OCLMemoryPool&) = delete;
+    OCLMemoryPool& operator=(const OCLMemoryPool&) = delete;
+
+    // Returns a recycled block with the same key or allocates a new one, the block goes back to the pool when the
+    // last copy of the returned pointer is released.
+    std::shared_ptr<Block> acquire(const Key& key)
+    {
+        std::weak_ptr<State> weakState = _state;
+        auto deleter = [weakState](Block* block) { recycle(weakState, block); };
+
+        std::lock_guard<std::mutex> guard(_state->mutex);
+        auto& statistics = _state->statistics;
+        statistics.requests++;
+
+        auto& idle = _state->idle;
+        for (auto it = idle.rbegin(); it != idle.rend(); it++)
+        {
+            if ((*it)->key == key)
+            {
+                Block* block = it->release();
+                idle.erase(std::next(it).base());
+                statistics.hits++;
+                statistics.bytesHeld -= key.bytes;
+                statistics.bytesInUse += key.bytes;
+                return std::shared_ptr<Block>(block, deleter);
+            }
+        }
+
+        cl::Buffer buffer(_state->context, key.flags, key.bytes);
+        statistics.bytesInUse += key.bytes;
+        statistics.peakBytes = std::max(statistics.peakBytes, statistics.bytesHeld + statistics.bytesInUse);
+        return std::shared_ptr<Block>(new Block{.key = key, .buffer = buffer, .image = cl::Memory()}, deleter);
+    }
+
+    // Caps the memory held by idle blocks, releasing the least recently used ones
+    void setMaxBytesHeld(size_t maxBytesHeld)
+    {
+        std::lock_guard<std::mutex> guard(_state->mutex);
+        _state->maxBytesHeld = maxBytesHeld;
+        evict(_state.get(), maxBytesHeld);
+    }
+
+    // Releases all idle blocks
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(_state->mutex);
+        evict(_state.get(), 0);
+    }
+
+    Statistics statistics() const
+    {
+        std::lock_guard<std::mutex> guard(_state->mutex);
+        return _state->statistics;
+    }
+};
+
+// Tunes the local work group size of kernels dispatched without an explicit one. Each (kernel name, global size) pair
+// cycles through candidate local sizes over its first dispatches, timing them with the profiling info of their events,
+// and then sticks to the fastest one. Since tuning happens on the application's own dispatches no kernel is ever run
+// twice, the timed queue needs CL_QUEUE_PROFILING_ENABLE though. Tuned sizes are saved to a tuning file, keyed by
+// device and driver, and reused by later runs.
+class OCLWorkGroupTuner
+{
+   public:
+    // Timed dispatches per candidate, the fastest one counts
+    static constexpr int samplesPerCandidate = 3;
+
+    // Dispatches left to the driver before tuning is retried, when a candidate could not be timed
+    static constexpr int untimedRetryInterval = 64;
+
+    OCLWorkGroupTuner(const cl::Device& device, const std::string& tuningFile);
+
+    // The local size to dispatch kernel with, {0, 0} leaves the choice to the driver. If the dispatch is to be timed
+    // candidate is set to a value >= 0 and the dispatch event has to be passed to record(), otherwise it is set to -1.
+    gls::size localSize(const cl::Kernel& kernel, const std::string& kernelName, const gls::size& gridSize,
+                        int* candidate);
+
+    void record(const std::string& kernelName, const gls::size& gridSize, int candidate, const cl::Event& event);
+
+    // The tuned local size, if tuning is complete
+    std::optional<gls::size> tunedSize(const std::string& kernelName, const gls::size& gridSize) const;
+
+    // Candidate local sizes for gridSize, starting with the driver's choice
+    static std::vector<gls::size> candidateSizes(const gls::size& gridSize, size_t maxWorkGroupSize);
+
+    void save() const;
+
+   private:
+    struct Candidate
+    {
+        gls::size localSize;
+        std::vector<cl::Event> pending;
+        std::vector<double> times;
+    };
+
+    struct Entry
+    {
+        std::vector<Candidate> candidates;
+        std::optional<gls::size> best;
+        // Dispatched on a queue without profiling: left to the driver, and not saved, for this many dispatches
+        int untimedDispatches = 0;
+    };
+
+    typedef std::tuple<std::string, int, int> Key;
+
+    const std::string _deviceKey;
+    const std::string _tuningFile;
+    mutable std::mutex _mutex;
+    std::map<Key, Entry> _entries;
+    std::vector<std::string> _otherDevices;  // Tuning file lines of other devices, preserved on save
+
+    void load();
+    void collectTimes(Entry* entry);
+};
+
+// Records the device timing of kernel dispatches and memory transfers from their events, aggregates per command
+// statistics and exports them as a Chrome trace (chrome://tracing, ui.perfetto.dev). Events are only resolved once
+// their command is complete, so recording never stalls the queue. Timing needs a queue created with
+// CL_QUEUE_PROFILING_ENABLE, commands from other queues are counted as unprofiled and ignored.
+//
+// Recorded commands are the kernels dispatched through OCLContext::dispatch() and GpuKernel::Enqueue(), and the
+// transfers, maps and fills of GpuBuffer, GpuImage and GpuImage3d, whose slices are GpuImages. Commands enqueued
+// directly on a cl::CommandQueue are not seen, GpuKernel subclasses dispatch with Enqueue() to be timed.
+class OCLProfiler
+{
+   public:
+    struct Record
+    {
+        std::string name;
+        std::string category;  // "kernel", "transfer" or "fill"
+        std::array<size_t, 3> globalSize;
+        int queue;  // Index of the command queue, in order of first use
+        // Device times in nanoseconds
+        cl_ulong queued, submit, start, end;
+    };
+
+    struct Statistics
+    {
+        size_t count = 0;
+        double totalMs = 0;
+        double minMs = std::numeric_limits<double>::max();
+        double maxMs = 0;
+
+        double meanMs() const { return count > 0 ? totalMs / count : 0; }
+    };
+
+    // At most maxRecords are kept, the oldest ones are dropped first. If traceFile is set the Chrome trace is saved
+    // to it when the profiler is destroyed.
+    OCLProfiler(size_t maxRecords = 1 << 20, const std::string& traceFile = "");
+
+    ~OCLProfiler();
+
+    void record(const std::string& name, const std::string& category, const cl::NDRange& globalSize,
+                const cl::Event& event);
+
+    // Resolve the timing of the completed commands, called by the accessors below
+    void collect();
+
+    std::vector<Record> records();
+
+    // Per command name statistics of the execution time (end - start)
+    std::map<std::string, Statistics> statistics();
+
+    // Commands recorded on queues without profiling
+    size_t unprofiledCount();
+
+    std::string chromeTrace();
+
+    void writeChromeTrace(const std::string& path);
+
+    void clear();
+
+   private:
+    struct Pending
+    {
+        std::string name;
+        std::string category;
+        std::array<size_t, 3> globalSize;
+        cl::Event event;
+    };
+
+    const size_t _maxRecords;
+    const std::string _traceFile;
+    std::mutex _mutex;
+    std::vector<Pending> _pending;
+    std::deque<Record> _records;
+    std::vector<cl_command_queue> _queues;
+    size_t _unprofiled = 0;
+
+    void collectLocked();
+};
+
+// Kernel objects of a program, by thread and kernel name. A kernel object is only used by the thread which created
+// it, so that setting arguments never races with a dispatch from a different thread. The kernels of a thread are
+// removed from all the caches it used when the thread exits.
+class OCLKernelCache : public std::enable_shared_from_this<OCLKernelCache>
+{
+   public:
+    cl::Kernel kernel(const cl::Program& program, const std::string& kernelName)
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        auto [threadKernels, inserted] = _kernels.try_emplace(std::this_thread::get_id());
+        if (inserted)
+        {
+            threadCleanup().caches.push_back(weak_from_this());
+        }
+        auto entry = threadKernels->second.find(kernelName);
+        if (entry == threadKernels->second.end())
+        {
+            entry = threadKernels->second.emplace(kernelName, cl::Kernel(program, kernelName.c_str())).first;
+        }
+        return entry->second;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _kernels.clear();
+    }
+
+    size_t threadCount()
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _kernels.size();
+    }
+
+   private:
+    struct ThreadCleanup
+    {
+        std::vector<std::weak_ptr<OCLKernelCache>> caches;
+
+        ~ThreadCleanup()
+        {
+            for (const auto& cache : caches)
+            {
+                if (auto c = cache.lock())
+                {
+                    std::lock_guard<std::mutex> guard(c->_mutex);
+                    c->_kernels.erase(std::this_thread::get_id());
+                }
+            }
+        }
+    };
+
+    static ThreadCleanup& threadCleanup()
+    {
+        static thread_local ThreadCleanup cleanup;
+        // Forget the caches of destroyed contexts
+        std::erase_if(cleanup.caches, [](const auto& cache) { return cache.expired(); });
+        return cleanup;
+    }
+
+    std::mutex _mutex;
+    std::map<std::thread::id, std::map<std::string, cl::Kernel>> _kernels;
+};
+
 class OCLContext : public GpuContext
 {
     cl::Context _clContext;
     cl::Program _program;
     cl::CommandQueue _commandQueue;
     std::string _shadersRootPath;
+    std::shared_ptr<OCLMemoryPool> _memoryPool;
+
+    // Guards _program, which kernel() reads while setProgram() may replace it
+    mutable std::mutex _programMutex;
+    std::shared_ptr<OCLKernelCache> _kernelCache = std::make_shared<OCLKernelCache>();
+
+    std::shared_ptr<OCLWorkGroupTuner> _workGroupTuner;
+    std::shared_ptr<OCLProfiler> _profiler;
+
+    // The local work group size for dispatches that don't specify one
+    cl::NDRange tunedLocalSize(const cl::Kernel& kernel, const std::string& kernelName, const gls::size& gridSize,
+                               int* candidate) const
+    {
+        *candidate = -1;
+        if (_workGroupTuner)
+        {
+            gls::size size = _workGroupTuner->localSize(kernel, kernelName, gridSize, candidate);
+            if (size.width > 0 && size.height > 0)
+            {
+                return cl::NDRange(size.width, size.height);
+            }
+        }
+        return cl::NullRange;
+    }
+
+    void setProgram(const cl::Program& program)
+    {
+        std::lock_guard<std::mutex> guard(_programMutex);
+        _program = program;
+        _kernelCache->clear();
+    }
 
 #if defined(__ANDROID__) && defined(USE_ASSET_MANAGER)
     std::map<std::string, std::string> cl_shaders;
@@ -203,6 +581,13 @@ class OCLContext : public GpuContext
 #endif
 #endif
 
+        // $GLS_OPENCL_PROFILING enables profiling from the start, saving a Chrome trace to its value if that is a path
+        const char* profiling = getenv("GLS_OPENCL_PROFILING");
+        if (profiling)
+        {
+            queueProperties = queueProperties.value_or(0) | CL_QUEUE_PROFILING_ENABLE;
+        }
+
         // Initialize command queue - create dedicated queue if properties specified, otherwise use default
         if (queueProperties.has_value())
         {
@@ -215,6 +600,16 @@ class OCLContext : public GpuContext
 
         //       TODO: FIGURE OUT WHY THIS IS COMMENTED IN DOUG's version
         //        loadPrograms(programs);
+
+        if (const char* tuningFile = getenv("GLS_OPENCL_TUNING_FILE"))
+        {
+            enableWorkGroupTuning(tuningFile);
+        }
+        if (profiling)
+        {
+            const std::string traceFile = profiling;
+            _profiler = std::make_shared<OCLProfiler>(1 << 20, traceFile == "1" ? "" : traceFile);
+        }
     }
 
     // Factory method for creating a new context with a new queue. Allows for creating a context with compiled programs
@@ -232,8 +627,11 @@ class OCLContext : public GpuContext
 
         // Copy shared resources from the original context
         new_context->_clContext = _clContext;
-        new_context->_program = _program;
+        new_context->setProgram(_program);
         new_context->_shadersRootPath = _shadersRootPath;
+        new_context->_memoryPool = _memoryPool;
+        new_context->_workGroupTuner = _workGroupTuner;
+        new_context->_profiler = _profiler;
 
 #if defined(__ANDROID__) && defined(USE_ASSET_MANAGER)
         // Copy shader maps if they exist
@@ -265,9 +663,83 @@ class OCLContext : public GpuContext
     virtual ~OCLContext() { waitForCompletion(); }
 
     cl::Context clContext() const { return _clContext; }
-    cl::Program clProgram() const { return _program; }
+    cl::Program clProgram() const
+    {
+        std::lock_guard<std::mutex> guard(_programMutex);
+        return _program;
+    }
     cl::CommandQueue clCommandQueue() const { return _commandQueue; }
 
+    // The kernel named kernelName of the context's program, see OCLKernelCache. The kernel is returned by value, a
+    // reference counted handle, so that reloading the program while it is used can't invalidate it.
+    cl::Kernel kernel(const std::string& kernelName) const
+    {
+        std::lock_guard<std::mutex> guard(_programMutex);
+        return _kernelCache->kernel(_program, kernelName);
+    }
+
+    // Number of threads with cached kernel objects
+    size_t kernelCacheThreadCount() const { return _kernelCache->threadCount(); }
+
+    // Serve new GpuBuffer, GpuImage and GpuImage3d allocations from a pool of recycled device memory, keeping at most
+    // maxBytesHeld bytes of idle blocks. Contexts derived with createWithNewQueue share the pool.
+    void enableMemoryPool(size_t maxBytesHeld = 1024 * 1024 * 1024)
+    {
+        if (_memoryPool)
+        {
+            _memoryPool->setMaxBytesHeld(maxBytesHeld);
+        }
+        else
+        {
+            _memoryPool = std::make_shared<OCLMemoryPool>(_clContext, maxBytesHeld);
+        }
+    }
+
+    void disableMemoryPool() { _memoryPool = nullptr; }
+
+    // The memory pool, or nullptr if pooling is disabled (the default)
+    std::shared_ptr<OCLMemoryPool> memoryPool() const { return _memoryPool; }
+
+    // Auto-tune the local work group size of dispatches which don't specify one, loading and saving the tuned sizes
+    // from tuningFile (an empty path keeps them in memory). Also enabled at construction by $GLS_OPENCL_TUNING_FILE.
+    // New sizes are only tuned on queues created with CL_QUEUE_PROFILING_ENABLE: when a dispatch can't be timed the
+    // kernel runs with the driver's choice for OCLWorkGroupTuner::untimedRetryInterval dispatches, then tuning is
+    // retried. Several processes can share a tuning file, the last one to save wins.
+    void enableWorkGroupTuning(const std::string& tuningFile)
+    {
+        _workGroupTuner = std::make_shared<OCLWorkGroupTuner>(cl::Device::getDefault(), tuningFile);
+    }
+
+    void disableWorkGroupTuning() { _workGroupTuner = nullptr; }
+
+    std::shared_ptr<OCLWorkGroupTuner> workGroupTuner() const { return _workGroupTuner; }
+
+    // Record the timing of every kernel dispatch and memory transfer issued through this context, its GpuKernels,
+    // GpuBuffers and GpuImages. Contexts derived with createWithNewQueue share the profiler. Only commands on queues
+    // created with CL_QUEUE_PROFILING_ENABLE are timed, see OCLProfiler.
+    void enableProfiling(size_t maxRecords = 1 << 20)
+    {
+        if (!_profiler)
+        {
+            _profiler = std::make_shared<OCLProfiler>(maxRecords);
+        }
+    }
+
+    void disableProfiling() { _profiler = nullptr; }
+
+    // The profiler, or nullptr if profiling is disabled (the default)
+    std::shared_ptr<OCLProfiler> profiler() const { return _profiler; }
+
+    // Report a command to the profiler, if enabled
+    void profile(const std::string& name, const std::string& category, const cl::NDRange& globalSize,
+                 const cl::Event& event) const
+    {
+        if (_profiler)
+        {
+            _profiler->record(name, category, globalSize, event);
+        }
+    }
+
     inline static std::vector<int> computeDivisors(const size_t val)
     {
         std::vector<int> divisors;
@@ -399,9 +871,8 @@ class OCLContext : public GpuContext
             const std::string combinedOptions = std::string(cl_options) + " " + compileOptions;
 
             device = cl::Device::getDefault();
-            program = cl::Program(programSources);
-            program.build(device, combinedOptions.c_str());
-            _program = program;
+            program = buildProgramWithCache(_clContext, device, programSources, combinedOptions);
+            setProgram(program);
         }
         catch (const cl::BuildError& e)
         {
@@ -442,7 +913,7 @@ class OCLContext : public GpuContext
             cl::Program program =
                 cl::Program(cl::Context::getDefault(), devices, (cl::Program::Binaries)binaries, &binaryStatus, &err);
             program.build();
-            _program = program;
+            setProgram(program);
 
             if (err != CL_SUCCESS)
             {
@@ -493,7 +964,7 @@ class OCLContext : public GpuContext
                 sources.push_back(source);
             }
 
-            program = cl::Program(sources);
+            program = buildProgramWithCache(_clContext, device, sources, cl_options);
 #else
             //            cl::Program::Binaries
             std::vector<std::vector<unsigned char>> binary_list = {};
@@ -551,15 +1022,15 @@ class OCLContext : public GpuContext
             //            cl::Program program = cl::Program(_clContext, {device}, {OpenCLBinary(programNames[0] +
             //            ".o")});
 
-#endif
             program.build(device, cl_options);
+#endif
 
             //            std::string name  = device.getInfo<CL_DEVICE_NAME>();
             //            std::string buildlog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
             //            __android_log_print(ANDROID_LOG_INFO, "foo",  "Build log for: %s: %s", name.c_str(),
             //            buildlog.c_str());
 
-            _program = program;
+            setProgram(program);
         }
         catch (const cl::BuildError& e)
         {
@@ -645,7 +1116,7 @@ class OCLContext : public GpuContext
                                const cl::CommandQueue& queue, const std::vector<cl::Event>& waitEvents = {},
                                cl::Event* outputEvent = nullptr) const
     {
-        cl::Kernel kernel(_program, kernelName.c_str());
+        cl::Kernel kernel = this->kernel(kernelName);
         OCLCommandEncoder encoder(kernel);
 
         encodeKernelParameters(&encoder);
@@ -653,19 +1124,11 @@ class OCLContext : public GpuContext
         cl::NDRange global_workgroup_size = cl::NDRange(gridSize.width, gridSize.height);
         cl::NDRange local_workgroup_size = cl::NDRange(threadGroupSize.width, threadGroupSize.height);
 
-        if (outputEvent)
-        {
-            queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_workgroup_size, local_workgroup_size, &waitEvents,
-                                       outputEvent);
-            return *outputEvent;
-        }
-        else
-        {
-            cl::Event event;
-            queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_workgroup_size, local_workgroup_size, &waitEvents,
-                                       &event);
-            return event;
-        }
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_workgroup_size, local_workgroup_size, &waitEvents,
+                                   outputEvent ? outputEvent : &event);
+        profile(kernelName, "kernel", global_workgroup_size, outputEvent ? *outputEvent : event);
+        return outputEvent ? *outputEvent : event;
     }
 
     cl::Event enqueueWithEvent(const std::string& kernelName, const gls::size& gridSize,
@@ -675,20 +1138,24 @@ class OCLContext : public GpuContext
     {
         try
         {
-            cl::Kernel kernel(_program, kernelName.c_str());
+            cl::Kernel kernel = this->kernel(kernelName);
             OCLCommandEncoder encoder(kernel);
 
             encodeKernelParameters(&encoder);
 
             cl::NDRange global_workgroup_size = cl::NDRange(gridSize.width, gridSize.height);
+            int candidate;
+            cl::NDRange local_workgroup_size = tunedLocalSize(kernel, kernelName, gridSize, &candidate);
 
-            if (!outputEvent)
+            cl::Event event;
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_workgroup_size, local_workgroup_size,
+                                       &waitEvents, outputEvent ? outputEvent : &event);
+            if (candidate >= 0)
             {
-                outputEvent = new cl::Event();
+                _workGroupTuner->record(kernelName, gridSize, candidate, outputEvent ? *outputEvent : event);
             }
-            queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_workgroup_size, cl::NullRange, &waitEvents,
-                                       outputEvent);
-            return *outputEvent;
+            profile(kernelName, "kernel", global_workgroup_size, outputEvent ? *outputEvent : event);
+            return outputEvent ? *outputEvent : event;
         }
         catch (const cl::Error& e)
         {
@@ -701,6 +1168,89 @@ class OCLContext : public GpuContext
             throw std::runtime_error("OpenCL Kernel Error");
         }
     }
+
+    // Typed kernel argument binding for dispatch(), without the GpuCommandEncoder indirection
+    template <size_t N, typename T>
+    static void setKernelArg(cl::Kernel& kernel, unsigned index, const gls::Vector<N, T>& vec)
+    {
+        kernel.setArg(index, sizeof(T) * vec.size(), vec.data());
+    }
+
+    template <Derived<gls::buffer> T>
+    static void setKernelArg(cl::Kernel& kernel, unsigned index, const T& val)
+    {
+        // The platform buffers of an OCLContext are always ocl_buffers
+        kernel.setArg(index, static_cast<const ocl_buffer*>(val())->buffer());
+    }
+
+    template <Derived<gls::texture> T>
+    static void setKernelArg(cl::Kernel& kernel, unsigned index, const T& val)
+    {
+        // ocl_texture derives virtually from platform_texture, a static_cast can't reach it
+        if (const ocl_texture* t = dynamic_cast<const ocl_texture*>(val()))
+        {
+            kernel.setArg(index, t->image());
+        }
+        else
+        {
+            throw std::runtime_error("Unexpected texture type.");
+        }
+    }
+
+    template <Derived<cl::Memory> T>
+    static void setKernelArg(cl::Kernel& kernel, unsigned index, const T& val)
+    {
+        kernel.setArg(index, val);
+    }
+
+    template <typename T>
+    static void setKernelArg(cl::Kernel& kernel, unsigned index, const T& val)
+    {
+        kernel.setArg(index, sizeof(T), &val);
+    }
+
+    // Allocation free dispatch: the arguments are bound to the cached kernel directly by type, with no std::function
+    // or GpuCommandEncoder in between. A threadGroupSize of {0, 0} uses the tuned local work group size when tuning is
+    // enabled, and lets the driver choose otherwise.
+    template <typename... Ts>
+    cl::Event dispatch(const cl::CommandQueue& queue, const std::string& kernelName, const gls::size& gridSize,
+                       const gls::size& threadGroupSize, const std::vector<cl::Event>& waitEvents,
+                       const Ts&... args) const
+    {
+        try
+        {
+            cl::Kernel kernel = this->kernel(kernelName);
+            unsigned index = 0;
+            (setKernelArg(kernel, index++, args), ...);
+
+            int candidate = -1;
+            const cl::NDRange local_workgroup_size = threadGroupSize.width > 0 && threadGroupSize.height > 0
+                                                         ? cl::NDRange(threadGroupSize.width, threadGroupSize.height)
+                                                         : tunedLocalSize(kernel, kernelName, gridSize, &candidate);
+            cl::Event event;
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(gridSize.width, gridSize.height),
+                                       local_workgroup_size, waitEvents.empty() ? nullptr : &waitEvents, &event);
+            if (candidate >= 0)
+            {
+                _workGroupTuner->record(kernelName, gridSize, candidate, event);
+            }
+            profile(kernelName, "kernel", cl::NDRange(gridSize.width, gridSize.height), event);
+            return event;
+        }
+        catch (const cl::Error& e)
+        {
+            gls::logging::LogError("GLS-OCL") << "OpenCL Kernel Error: " << kernelName.c_str() << " - " << e.what()
+                                              << ": " << clStatusToString(e.err()).c_str() << std::endl;
+            throw std::runtime_error("OpenCL Kernel Error");
+        }
+    }
+
+    template <typename... Ts>
+    cl::Event dispatch(const std::string& kernelName, const gls::size& gridSize, const gls::size& threadGroupSize,
+                       const std::vector<cl::Event>& waitEvents, const Ts&... args) const
+    {
+        return dispatch(_commandQueue, kernelName, gridSize, threadGroupSize, waitEvents, args...);
+    }
 };
 
 // OCL-specific kernel wrapper that supports event-based execution
@@ -713,52 +1263,51 @@ class OCLKernel : public Kernel<Ts...>
     // Regular execution (inherited from base class)
     using Kernel<Ts...>::operator();
 
-    // Event-based execution for cross-queue synchronization
+    // Event-based execution for cross-queue synchronization, these bind the arguments with OCLContext::dispatch
     cl::Event operator()(const OCLContext& ocl_context, const gls::size& gridSize, const Ts&... ts) const
     {
-        return ocl_context.enqueueWithEvent(this->_kernelName, gridSize, [&, this](GpuCommandEncoder* encoder)
-                                            { this->template setArgs<0>(encoder, std::forward<const Ts>(ts)...); });
+        return ocl_context.dispatch(this->_kernelName, gridSize, {0, 0}, {}, ts...);
     }
 
     cl::Event operator()(const OCLContext& ocl_context, const gls::size& gridSize, const gls::size& threadGroupSize,
                          const Ts&... ts) const
     {
-        return ocl_context.enqueueWithEvent(this->_kernelName, gridSize, threadGroupSize,
-                                            [&, this](GpuCommandEncoder* encoder)
-                                            { this->template setArgs<0>(encoder, std::forward<const Ts>(ts)...); });
+        return ocl_context.dispatch(this->_kernelName, gridSize, threadGroupSize, {}, ts...);
     }
 
     // Event-based execution with wait events
     cl::Event operator()(const OCLContext& ocl_context, const gls::size& gridSize,
                          const std::vector<cl::Event>& waitEvents, const Ts&... ts) const
     {
-        return ocl_context.enqueueWithEvent(
-            this->_kernelName, gridSize, [&, this](GpuCommandEncoder* encoder)
-            { this->template setArgs<0>(encoder, std::forward<const Ts>(ts)...); }, waitEvents);
+        return ocl_context.dispatch(this->_kernelName, gridSize, {0, 0}, waitEvents, ts...);
     }
 
     cl::Event operator()(const OCLContext& ocl_context, const gls::size& gridSize,
                          const std::vector<cl::Event>& waitEvents, cl::Event* outputEvent, const Ts&... ts) const
     {
-        return ocl_context.enqueueWithEvent(
-            this->_kernelName, gridSize, [&, this](GpuCommandEncoder* encoder)
-            { this->template setArgs<0>(encoder, std::forward<const Ts>(ts)...); }, waitEvents, outputEvent);
+        cl::Event event = ocl_context.dispatch(this->_kernelName, gridSize, {0, 0}, waitEvents, ts...);
+        if (outputEvent)
+        {
+            *outputEvent = event;
+        }
+        return event;
     }
 
     cl::Event operator()(const OCLContext& ocl_context, const gls::size& gridSize, const gls::size& threadGroupSize,
                          const std::vector<cl::Event>& waitEvents, const Ts&... ts) const
     {
-        return ocl_context.enqueueWithEvent(
-            this->_kernelName, gridSize, threadGroupSize, [&, this](GpuCommandEncoder* encoder)
-            { this->template setArgs<0>(encoder, std::forward<const Ts>(ts)...); }, waitEvents);
+        return ocl_context.dispatch(this->_kernelName, gridSize, threadGroupSize, waitEvents, ts...);
     }
 
     cl::Event operator()(const OCLContext& ocl_context, const gls::size& gridSize, const gls::size& threadGroupSize,
                          const std::vector<cl::Event>& waitEvents, cl::Event* outputEvent, const Ts&... ts) const
     {
-        return ocl_context.enqueueWithEvent(
-            this->_kernelName, gridSize, threadGroupSize, [&, this](GpuCommandEncoder* encoder)
-            { this->template setArgs<0>(encoder, std::forward<const Ts>(ts)...); }, waitEvents, outputEvent);
+        cl::Event event = ocl_context.dispatch(this->_kernelName, gridSize, threadGroupSize, waitEvents, ts...);
+        if (outputEvent)
+        {
+            *outputEvent = event;
+        }
+        return event;
     }
 };
 
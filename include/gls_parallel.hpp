@@ -0,0 +1,297 @@
+// Copyright (c) 2021-2023 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef gls_parallel_hpp
+#define gls_parallel_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "gls_geometry.hpp"
+
+namespace gls {
+
+// Number of hardware threads, never less than one
+inline int hardware_threads() { return std::max(1, (int)std::thread::hardware_concurrency()); }
+
+// Work-stealing thread pool. Every worker has its own task queue: tasks submitted from a worker go to the back of its
+// queue and are run in LIFO order, other tasks are distributed round robin, and idle workers steal from the front of
+// the other queues. Submitted tasks must not throw.
+class thread_pool {
+   public:
+    // Start threads workers (0 means one less than the hardware threads, as the thread calling parallel_for() also
+    // runs work items). On Linux and Android worker i is pinned to cpu_affinity[i % cpu_affinity.size()], affinity is
+    // best effort and ignored on other platforms.
+    explicit thread_pool(int threads = 0, const std::vector<int>& cpu_affinity = {}) {
+        const int workers = threads > 0 ? threads : std::max(1, hardware_threads() - 1);
+        for (int i = 0; i < workers; i++) {
+            _queues.push_back(std::make_unique<worker_queue>());
+        }
+        for (int i = 0; i < workers; i++) {
+            const int cpu = cpu_affinity.empty() ? -1 : cpu_affinity[i % cpu_affinity.size()];
+            _threads.emplace_back([this, i, cpu]() { worker(i, cpu); });
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // Runs the tasks still queued before joining the workers
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+    int size() const { return (int)_threads.size(); }
+
+    void submit(std::function<void()> task) {
+        const int queue =
+            current_worker().pool == this ? current_worker().index : (int)(_next_queue++ % _queues.size());
+        {
+            std::lock_guard<std::mutex> guard(_queues[queue]->mutex);
+            _queues[queue]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _pending++;
+        }
+        _wake.notify_one();
+    }
+
+    // Run body(i) for i in [0, count) on the calling thread and up to threads - 1 workers, at most size(). Work items
+    // are handed out dynamically, the first exception thrown by any item is rethrown to the caller. The caller never
+    // waits for a worker which did not start yet, so nested calls from within work items can't deadlock.
+    template <typename Body>
+    void parallel_for(int count, int threads, Body&& body) {
+        struct job {
+            std::atomic<int> next_item = 0;
+            int active = 0;
+            std::exception_ptr error = nullptr;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        auto state = std::make_shared<job>();
+
+        auto run_items = [state, count, &body]() {
+            for (int i = state->next_item++; i < count; i = state->next_item++) {
+                try {
+                    body(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(state->mutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                    // Drain the remaining work items
+                    state->next_item = count;
+                }
+            }
+        };
+
+        const int helpers = std::min({threads - 1, count - 1, size()});
+        for (int t = 0; t < helpers; t++) {
+            // Helpers starting after all the items are handed out return without touching body
+            submit([state, run_items]() {
+                {
+                    std::lock_guard<std::mutex> guard(state->mutex);
+                    state->active++;
+                }
+                run_items();
+                {
+                    std::lock_guard<std::mutex> guard(state->mutex);
+                    state->active--;
+                }
+                state->done.notify_all();
+            });
+        }
+        run_items();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&]() { return state->active == 0; });
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+   private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    struct worker_identity {
+        const thread_pool* pool = nullptr;
+        int index = 0;
+    };
+
+    static worker_identity& current_worker() {
+        static thread_local worker_identity identity;
+        return identity;
+    }
+
+    bool pop_task(int index, std::function<void()>* task) {
+        {
+            worker_queue& own = *_queues[index];
+            std::lock_guard<std::mutex> guard(own.mutex);
+            if (!own.tasks.empty()) {
+                *task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < _queues.size(); i++) {
+            worker_queue& victim = *_queues[(index + i) % _queues.size()];
+            std::lock_guard<std::mutex> guard(victim.mutex);
+            if (!victim.tasks.empty()) {
+                *task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker(int index, int cpu) {
+#if defined(__linux__)
+        if (cpu >= 0) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+        }
+#endif
+        current_worker() = {this, index};
+
+        std::function<void()> task;
+        while (true) {
+            if (pop_task(index, &task)) {
+                _pending--;
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this]() { return _stopping || _pending > 0; });
+            if (_stopping && _pending == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<worker_queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<unsigned> _next_queue = 0;
+    std::atomic<int> _pending = 0;  // Queued tasks, incremented under _mutex
+    bool _stopping = false;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+};
+
+namespace detail {
+inline std::mutex& default_thread_pool_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline std::shared_ptr<thread_pool>& default_thread_pool_instance() {
+    static std::shared_ptr<thread_pool> pool;
+    return pool;
+}
+}  // namespace detail
+
+// The library's thread pool, shared by parallel_for() and all the CPU image operations. Created on first use.
+inline std::shared_ptr<thread_pool> default_thread_pool() {
+    std::lock_guard<std::mutex> guard(detail::default_thread_pool_mutex());
+    auto& pool = detail::default_thread_pool_instance();
+    if (!pool) {
+        pool = std::make_shared<thread_pool>();
+    }
+    return pool;
+}
+
+// Replace the library's thread pool, see thread_pool(). Parallel operations already running keep using the previous
+// pool, which is destroyed once they complete.
+inline void configure_thread_pool(int threads, const std::vector<int>& cpu_affinity = {}) {
+    auto pool = std::make_shared<thread_pool>(threads, cpu_affinity);
+    std::lock_guard<std::mutex> guard(detail::default_thread_pool_mutex());
+    detail::default_thread_pool_instance().swap(pool);
+}
+
+// Run body(i) for i in [0, count) on up to max_threads threads (0 means all hardware threads), using the calling
+// thread and the default_thread_pool(), so never more threads than the pool's workers plus one. Work items are handed
+// out dynamically, the first exception thrown by any item is rethrown to the caller.
+template <typename Body>
+void parallel_for(int count, int max_threads, Body&& body) {
+    auto pool = default_thread_pool();
+    const int threads = std::min({count, max_threads > 0 ? max_threads : hardware_threads(), pool->size() + 1});
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+    pool->parallel_for(count, threads, body);
+}
+
+// Run row(y) for all the rows of image, in blocks of about 16K pixels handed out to up to max_threads threads.
+// Image is anything with width and height members, e.g.: gls::image.
+template <typename Image, typename Row>
+void parallel_rows(const Image& image, Row&& row, int max_threads = 0) {
+    const int height = image.height;
+    const int block_rows = std::max(1, 16384 / std::max(1, (int)image.width));
+    const int blocks = (height + block_rows - 1) / block_rows;
+    parallel_for(blocks, max_threads, [&](int block) {
+        const int end = std::min(height, (block + 1) * block_rows);
+        for (int y = block * block_rows; y < end; y++) {
+            row(y);
+        }
+    });
+}
+
+// Run process(rectangle) for the tiles of image, in row major order. Tiles on the right and bottom edges are clipped
+// to the image.
+template <typename Image, typename Process>
+void parallel_tiles(const Image& image, const gls::size& tile, Process&& process, int max_threads = 0) {
+    const int width = image.width;
+    const int height = image.height;
+    const int tiles_across = (width + tile.width - 1) / tile.width;
+    const int tiles_down = (height + tile.height - 1) / tile.height;
+    parallel_for(tiles_across * tiles_down, max_threads, [&](int index) {
+        const int x = (index % tiles_across) * tile.width;
+        const int y = (index / tiles_across) * tile.height;
+        process(gls::rectangle(x, y, std::min(tile.width, width - x), std::min(tile.height, height - y)));
+    });
+}
+
+}  // namespace gls
+
+#endif /* gls_parallel_hpp */
@@ -0,0 +1,48 @@
+// Copyright (c) 2021-2023 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef gls_raw_unpack_hpp
+#define gls_raw_unpack_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gls {
+
+// clang-format off
+
+// Packed raw sample layouts
+enum class raw_packing {
+    msb_10,         // 10 bit samples in a big endian bit stream, as in TIFF and DNG files
+    msb_12,         // 12 bit samples in a big endian bit stream
+    msb_14,         // 14 bit samples in a big endian bit stream
+    mipi_raw10,     // MIPI CSI-2 RAW10: the high bytes of 4 samples followed by a byte with their 2 low bits
+    mipi_raw12,     // MIPI CSI-2 RAW12: the high bytes of 2 samples followed by a byte with their 4 low bits
+};
+
+// clang-format on
+
+int raw_packing_bits(raw_packing packing);
+
+// Size in bytes of samples packed samples, partial MIPI groups take a whole group
+size_t packed_raw_size(raw_packing packing, size_t samples);
+
+// Unpack samples packed samples into 16 bit samples, reading exactly packed_raw_size(packing, samples) bytes.
+// AVX2, SSSE3 or NEON are used when available, use_simd = false selects the portable scalar implementation.
+void unpack_raw(raw_packing packing, const uint8_t* packed, uint16_t* unpacked, size_t samples, bool use_simd = true);
+
+}  // namespace gls
+
+#endif /* gls_raw_unpack_hpp */
@@ -30,10 +30,7 @@ class ReadIrregular2d : gls::GpuKernel
                          const std::vector<cl::Event>& events = {})
     {
         SetArgs(image.image(), dist);
-        cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
-        cl::Event event;
-        _queue.enqueueNDRangeKernel(kernel_, {}, {image.width_, image.height_, 1}, {}, &events, &event);
-        return event;
+        return Enqueue({image.width_, image.height_, 1}, cl::NullRange, queue, events);
     }
 };
 
@@ -15,9 +15,18 @@
 
 #include "gls_cl.hpp"
 
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
 
 #include "gls_logging.h"
 
@@ -187,12 +196,12 @@ cl::Program OpenCLContext::loadProgram(const std::string& programName, const std
 
         if (!binary.empty()) {
             program = cl::Program(context, {device}, {binary});
+            program.build(device, cl_options);
         } else
 #endif
         {
-            program = cl::Program(OpenCLSource(programName + ".cl"));
+            program = buildProgramWithCache(context, device, {OpenCLSource(programName + ".cl")}, cl_options);
         }
-        program.build(device, cl_options);
         _program_cache[programName] = program;
         return program;
     } catch (const cl::BuildError& e) {
@@ -217,6 +226,155 @@ int OpenCLContext::buildProgram(cl::Program& program) {
     return 0;
 }
 
+static std::mutex programCacheMutex;
+static std::optional<std::string> programCachePath;
+static std::string programCacheSalt;
+
+void setProgramCacheDirectory(const std::string& path, const std::string& versionSalt) {
+    std::lock_guard<std::mutex> guard(programCacheMutex);
+    programCachePath = path;
+    programCacheSalt = versionSalt;
+}
+
+static void initProgramCacheSettings() {
+    if (!programCachePath) {
+        const char* path = getenv("GLS_OPENCL_CACHE_DIR");
+        const char* salt = getenv("GLS_OPENCL_CACHE_SALT");
+        programCachePath = path ? path : "";
+        programCacheSalt = salt ? salt : "";
+    }
+}
+
+std::string programCacheDirectory() {
+    std::lock_guard<std::mutex> guard(programCacheMutex);
+    initProgramCacheSettings();
+    return *programCachePath;
+}
+
+static std::string programCacheVersionSalt() {
+    std::lock_guard<std::mutex> guard(programCacheMutex);
+    initProgramCacheSettings();
+    return programCacheSalt;
+}
+
+// 64 bit FNV-1a
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ ((const uint8_t*)data)[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static std::string programCacheKey(const cl::Device& device, const std::vector<std::string>& sources,
+                                   const std::string& options) {
+    uint64_t sourceHash = hashBytes(nullptr, 0);
+    for (const auto& source : sources) {
+        uint64_t size = source.size();
+        sourceHash = hashBytes(&size, sizeof(size), sourceHash);
+        sourceHash = hashBytes(source.data(), source.size(), sourceHash);
+    }
+
+    std::stringstream key;
+    key << device.getInfo<CL_DEVICE_NAME>() << "|" << device.getInfo<CL_DEVICE_VERSION>() << "|"
+        << device.getInfo<CL_DRIVER_VERSION>() << "|" << options << "|" << programCacheVersionSalt() << "|" << std::hex
+        << sourceHash;
+    return key.str();
+}
+
+// Cache files start with the full key, which is checked on load to rule out hash collisions
+static const char programCacheMagic[8] = {'G', 'L', 'S', 'C', 'L', 'B', 'I', 'N'};
+
+static std::vector<unsigned char> readCachedBinary(const std::string& path, const std::string& key) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    char magic[sizeof(programCacheMagic)];
+    uint64_t keySize, binarySize;
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, programCacheMagic, sizeof(magic)) != 0 ||
+        !file.read((char*)&keySize, sizeof(keySize)) || keySize != key.size()) {
+        return {};
+    }
+    std::string fileKey(keySize, '\0');
+    if (!file.read(fileKey.data(), keySize) || fileKey != key || !file.read((char*)&binarySize, sizeof(binarySize))) {
+        return {};
+    }
+    std::vector<unsigned char> binary(binarySize);
+    if (!file.read((char*)binary.data(), binarySize)) {
+        return {};
+    }
+    return binary;
+}
+
+static void writeCachedBinary(const std::string& path, const std::string& key,
+                              const std::vector<unsigned char>& binary) {
+    // Write to a temporary file and rename it, so that concurrent processes never see a partial file
+    const std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        uint64_t keySize = key.size(), binarySize = binary.size();
+        file.write(programCacheMagic, sizeof(programCacheMagic));
+        file.write((const char*)&keySize, sizeof(keySize));
+        file.write(key.data(), keySize);
+        file.write((const char*)&binarySize, sizeof(binarySize));
+        file.write((const char*)binary.data(), binarySize);
+        if (!file) {
+            gls::logging::LogError(TAG) << "Couldn't write OpenCL program cache file " << tmpPath << std::endl;
+            file.close();
+            remove(tmpPath.c_str());
+            return;
+        }
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+    }
+}
+
+cl::Program buildProgramWithCache(const cl::Context& context, const cl::Device& device,
+                                  const std::vector<std::string>& sources, const std::string& options) {
+    const std::string cacheDirectory = programCacheDirectory();
+    if (cacheDirectory.empty()) {
+        cl::Program program(context, sources);
+        program.build(device, options.c_str());
+        return program;
+    }
+
+    const std::string key = programCacheKey(device, sources, options);
+    std::stringstream fileName;
+    fileName << std::hex << hashBytes(key.data(), key.size()) << ".bin";
+    const std::string path = cacheDirectory + "/" + fileName.str();
+
+    std::vector<unsigned char> binary = readCachedBinary(path, key);
+    if (!binary.empty()) {
+        try {
+            cl::Program program(context, {device}, {binary});
+            program.build(device, options.c_str());
+            return program;
+        } catch (const cl::Error& e) {
+            // Stale or corrupted binary, rebuild from source
+            gls::logging::LogInfo(TAG) << "Discarding cached OpenCL program " << path << ": "
+                                       << clStatusToString(e.err()) << std::endl;
+            remove(path.c_str());
+        }
+    }
+
+    cl::Program program(context, sources);
+    program.build(device, options.c_str());
+
+    try {
+        const auto devices = program.getInfo<CL_PROGRAM_DEVICES>();
+        const auto binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+        for (size_t i = 0; i < devices.size() && i < binaries.size(); i++) {
+            if (devices[i] == device && !binaries[i].empty()) {
+                std::error_code error;
+                std::filesystem::create_directories(cacheDirectory, error);
+                writeCachedBinary(path, key, binaries[i]);
+            }
+        }
+    } catch (const cl::Error& e) {
+        gls::logging::LogError(TAG) << "Couldn't retrieve OpenCL program binary: " << clStatusToString(e.err())
+                                    << std::endl;
+    }
+    return program;
+}
+
 // Compute a list of divisors in the range [1..32]
 static std::vector<int> computeDivisors(const size_t val) {
     std::vector<int> divisors;
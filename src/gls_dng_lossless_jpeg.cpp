@@ -58,7 +58,10 @@
 
 #include <stdio.h>
 
+#include <bit>
+
 #include "gls_logging.h"
+#include "gls_parallel.hpp"
 
 static const char* TAG = "LOSSLESS_JPEG";
 
@@ -382,6 +385,11 @@ struct DecompressInfo {
      */
     HuffmanTable* dcHuffTblPtrs[4];
 
+    /*
+     * ptrs to the Huffman lookup tables, or NULL to use the reference decoder
+     */
+    int32_t* dcLookupTblPtrs[4];
+
     /*
      * prediction selection value (PSV) and point transform parameter (Pt)
      */
@@ -412,16 +420,37 @@ typedef ComponentType* MCU;  // MCU - array of samples
 
 /*****************************************************************************/
 
+// Huffman lookup table, indexed by the next kHuffmanLookupBits of the
+// bit stream. Each entry resolves the code length together with the
+// extended difference value when both fit in the lookup window:
+//
+//    bits  0-4: number of bits to consume, 0 = code longer than the window
+//    bit     5: kLookupResolved, the difference is in bits 16-31
+//    bits 8-15: the decoded symbol (difference size), when not resolved
+
+const int32_t kHuffmanLookupBits = 12;
+const int32_t kLookupResolved = 1 << 5;
+
+/*****************************************************************************/
+
 class dng_lossless_decoder {
    private:
     dng_stream* fStream;  // Input data.
 
     dng_spooler* fSpooler;  // Output data.
 
+    dng_decode_destination fOutput;  // Direct output, used instead of fSpooler when set.
+
+    int32_t fFirstRow;  // Index of the first decoded row, for restart segments.
+
     bool fBug16;  // Decode data with the "16-bit" bug.
 
     dng_memory_data huffmanBuffer[4];
 
+    dng_memory_data lookupBuffer[4];
+
+    bool fUseLookupTables;  // Use the table driven Huffman decoder.
+
     dng_memory_data compInfoBuffer;
 
     DecompressInfo info;
@@ -442,11 +471,14 @@ class dng_lossless_decoder {
 #endif
 
    public:
-    dng_lossless_decoder(dng_stream* stream, dng_spooler* spooler, bool bug16);
+    dng_lossless_decoder(dng_stream* stream, dng_spooler* spooler, bool bug16, bool useLookupTables = true);
+
+    dng_lossless_decoder(dng_stream* stream, const dng_decode_destination& destination, bool bug16,
+                         bool useLookupTables = true);
 
     void StartRead(uint32_t& imageWidth, uint32_t& imageHeight, uint32_t& imageChannels);
 
-    void FinishRead();
+    void FinishRead(int32_t threads = 1);
 
 #if qSupportHasselblad_3FR
 
@@ -493,6 +525,10 @@ class dng_lossless_decoder {
 
     void FillBitBuffer(int32_t nbits);
 
+    void FillBitBuffer64();
+
+    void BuildLookupTable(int32_t tblNo);
+
     int32_t show_bits8();
 
     void flush_bits(int32_t nbits);
@@ -505,22 +541,35 @@ class dng_lossless_decoder {
 
     void HuffExtend(int32_t& x, int32_t s);
 
+    int32_t DecodeDifference(HuffmanTable* htbl, const int32_t* lookup);
+
     void PmPutRow(MCU* buf, int32_t numComp, int32_t numCol, int32_t row);
 
+    void PutDestinationRow(const uint16_t* sPtr, uint32_t pixels, int32_t row);
+
+    void DestinationRows(uint32_t pixels, int64_t& firstRow, int64_t& endRow) const;
+
     void DecodeFirstRow(MCU* curRowBuf);
 
     void DecodeImage();
+
+    bool FindRestartSegments(std::vector<size_t>& segmentStarts);
+
+    void DecodeRestartSegments(int32_t threads);
 };
 
 /*****************************************************************************/
 
-dng_lossless_decoder::dng_lossless_decoder(dng_stream* stream, dng_spooler* spooler, bool bug16)
+dng_lossless_decoder::dng_lossless_decoder(dng_stream* stream, dng_spooler* spooler, bool bug16, bool useLookupTables)
 
     : fStream(stream),
       fSpooler(spooler),
+      fOutput(),
+      fFirstRow(0),
       fBug16(bug16)
 
       ,
+      fUseLookupTables(useLookupTables),
       compInfoBuffer(),
       info(),
       mcuBuffer1(),
@@ -542,6 +591,14 @@ dng_lossless_decoder::dng_lossless_decoder(dng_stream* stream, dng_spooler* spoo
 
 /*****************************************************************************/
 
+dng_lossless_decoder::dng_lossless_decoder(dng_stream* stream, const dng_decode_destination& destination, bool bug16,
+                                           bool useLookupTables)
+    : dng_lossless_decoder(stream, (dng_spooler*)NULL, bug16, useLookupTables) {
+    fOutput = destination;
+}
+
+/*****************************************************************************/
+
 uint16_t dng_lossless_decoder::Get2bytes() {
     uint16_t a = GetJpegChar();
 
@@ -1171,6 +1228,10 @@ void dng_lossless_decoder::HuffDecoderInit() {
         // big deal
 
         FixHuffTbl(info.dcHuffTblPtrs[compptr->dcTblNo]);
+
+        if (fUseLookupTables) {
+            BuildLookupTable(compptr->dcTblNo);
+        }
     }
 
     // Initialize restart stuff
@@ -1356,6 +1417,150 @@ inline void dng_lossless_decoder::FillBitBuffer(int32_t nbits) {
 
 /*****************************************************************************/
 
+/*
+ *--------------------------------------------------------------
+ *
+ * FillBitBuffer64 --
+ *
+ *    Load up the 64 bit buffer with at least 32 bits. Whole
+ *    bytes are loaded with a single big endian read when none
+ *    of them is 0xFF, otherwise the bytes are processed one at
+ *    a time to handle stuffed bytes and markers.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The bitwise global variables are updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+inline void dng_lossless_decoder::FillBitBuffer64() {
+    const int32_t count = (64 - bitsLeft) >> 3;
+
+    const size_t position = fStream->Position();
+
+    if (position + 8 < fStream->Length()) {
+        uint64_t word;
+
+        memcpy(&word, fStream->Data() + position, sizeof(word));
+
+        word = __builtin_bswap64(word);
+
+        // Look for 0xFF bytes among the ones we are going to load,
+        // false positives only send us to the slow path.
+
+        const uint64_t ones = 0x0101010101010101ULL;
+
+        uint64_t inverted = ~word;
+
+        if (count < 8) {
+            inverted |= ~0ULL >> (8 * count);
+        }
+
+        if (((inverted - ones) & ~inverted & (ones << 7)) == 0) {
+            getBuffer = count == 8 ? word : (getBuffer << (8 * count)) | (word >> (64 - 8 * count));
+
+            bitsLeft += 8 * count;
+
+            fStream->SetReadPosition(position + count);
+
+            return;
+        }
+    }
+
+    while (bitsLeft <= 56) {
+        int32_t c = GetJpegChar();
+
+        // If it's 0xFF, check and discard stuffed zero byte
+
+        if (c == 0xFF) {
+            int32_t c2 = GetJpegChar();
+
+            if (c2 != 0) {
+                // A marker, put it back for use later and stuff
+                // zeroes if we need more bits.
+
+                UnGetJpegChar();
+                UnGetJpegChar();
+
+                if (bitsLeft >= 32) break;
+
+                c = 0;
+            }
+        }
+
+        getBuffer = (getBuffer << 8) | c;
+
+        bitsLeft += 8;
+    }
+}
+
+/*****************************************************************************/
+
+/*
+ *--------------------------------------------------------------
+ *
+ * BuildLookupTable --
+ *
+ *    Build the kHuffmanLookupBits wide lookup table for a Huffman
+ *    table, after FixHuffTbl has computed the code of each symbol.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    info.dcLookupTblPtrs[tblNo] is set.
+ *
+ *--------------------------------------------------------------
+ */
+
+void dng_lossless_decoder::BuildLookupTable(int32_t tblNo) {
+    const HuffmanTable* htbl = info.dcHuffTblPtrs[tblNo];
+
+    const int32_t lookupSize = 1 << kHuffmanLookupBits;
+
+    lookupBuffer[tblNo].Allocate(lookupSize, sizeof(int32_t));
+
+    int32_t* lookup = (int32_t*)lookupBuffer[tblNo].Buffer();
+
+    memset(lookup, 0, lookupSize * sizeof(int32_t));
+
+    for (int32_t s = 0; s < 256; s++) {
+        int32_t size = htbl->ehufsi[s];
+
+        if (size <= 0 || size > kHuffmanLookupBits || htbl->ehufco[s] >= (1 << size)) {
+            continue;
+        }
+
+        int32_t first = htbl->ehufco[s] << (kHuffmanLookupBits - size);
+        int32_t last = first + (1 << (kHuffmanLookupBits - size));
+
+        for (int32_t index = first; index < last; index++) {
+            int32_t entry;
+
+            if (s == 0 || (s == 16 && !fBug16)) {
+                entry = ((s ? -32768 : 0) * (1 << 16)) | kLookupResolved | size;
+            } else if (s < 16 && size + s <= kHuffmanLookupBits) {
+                int32_t d = (index >> (kHuffmanLookupBits - size - s)) & ((1 << s) - 1);
+
+                HuffExtend(d, s);
+
+                entry = (d * (1 << 16)) | kLookupResolved | (size + s);
+            } else {
+                entry = (s << 8) | size;
+            }
+
+            lookup[index] = entry;
+        }
+    }
+
+    info.dcLookupTblPtrs[tblNo] = lookup;
+}
+
+/*****************************************************************************/
+
 inline int32_t dng_lossless_decoder::show_bits8() {
     if (bitsLeft < 8) FillBitBuffer(8);
 
@@ -1500,14 +1705,128 @@ inline void dng_lossless_decoder::HuffExtend(int32_t& x, int32_t s) {
 
 /*****************************************************************************/
 
+/*
+ *--------------------------------------------------------------
+ *
+ * DecodeDifference --
+ *
+ *    Decode the next Huffman coded difference (Section F.2.2.1).
+ *    With a lookup table the code length and the extended
+ *    difference are usually resolved with a single table access,
+ *    longer codes fall back to the reference HuffDecode.
+ *
+ * Results:
+ *    The difference value.
+ *
+ * Side effects:
+ *    Bitstream is parsed.
+ *
+ *--------------------------------------------------------------
+ */
+
+inline int32_t dng_lossless_decoder::DecodeDifference(HuffmanTable* htbl, const int32_t* lookup) {
+    int32_t s;
+
+    if (lookup) {
+        // Room for the longest code and difference, 16 + 16 bits
+
+        if (bitsLeft < 32) FillBitBuffer64();
+
+        int32_t entry = lookup[(getBuffer >> (bitsLeft - kHuffmanLookupBits)) & ((1 << kHuffmanLookupBits) - 1)];
+
+        if (entry & kLookupResolved) {
+            bitsLeft -= entry & 0x1F;
+
+            return entry >> 16;
+        }
+
+        if (entry) {
+            bitsLeft -= entry & 0x1F;
+
+            s = (entry >> 8) & 0xFF;
+        } else {
+            s = HuffDecode(htbl);
+        }
+    } else {
+        s = HuffDecode(htbl);
+    }
+
+    int32_t d = 0;
+
+    if (s) {
+        if (s == 16 && !fBug16) {
+            d = -32768;
+        } else {
+            d = get_bits(s);
+            HuffExtend(d, s);
+        }
+    }
+
+    return d;
+}
+
+/*****************************************************************************/
+
 // Called from DecodeImage () to write one row.
 
-inline void dng_lossless_decoder::PmPutRow(MCU* buf, int32_t numComp, int32_t numCol, int32_t /* row */) {
+inline void dng_lossless_decoder::PmPutRow(MCU* buf, int32_t numComp, int32_t numCol, int32_t row) {
     uint16_t* sPtr = &buf[0][0];
 
     uint32_t pixels = numCol * numComp;
 
-    fSpooler->Spool(sPtr, pixels * (uint32_t)sizeof(uint16_t));
+    if (fOutput.data) {
+        PutDestinationRow(sPtr, pixels, row);
+    } else {
+        fSpooler->Spool(sPtr, pixels * (uint32_t)sizeof(uint16_t));
+    }
+}
+
+/*****************************************************************************/
+
+// Copy one decoded row to the destination window. When the destination
+// row width differs from the JPEG row width a JPEG row may span several
+// destination rows, or just part of one.
+
+void dng_lossless_decoder::PutDestinationRow(const uint16_t* sPtr, uint32_t pixels, int32_t row) {
+    const int64_t rowSamples = fOutput.rowSamples ? fOutput.rowSamples : pixels;
+
+    const int64_t windowStart = fOutput.offsetX;
+    const int64_t windowEnd = fOutput.offsetX + (int64_t)fOutput.width;
+
+    int64_t index = (int64_t)(fFirstRow + row) * pixels;
+
+    for (uint32_t done = 0; done < pixels;) {
+        const int64_t y = index / rowSamples - fOutput.offsetY;
+        const int64_t x = index % rowSamples;
+        const int64_t count = std::min<int64_t>(pixels - done, rowSamples - x);
+
+        if (y >= (int64_t)fOutput.height) {
+            break;
+        }
+
+        const int64_t x0 = std::max(x, windowStart);
+        const int64_t x1 = std::min(x + count, windowEnd);
+
+        if (y >= 0 && x1 > x0) {
+            memcpy(fOutput.data + y * fOutput.rowStep + (x0 - windowStart), sPtr + done + (x0 - x),
+                   (x1 - x0) * sizeof(uint16_t));
+        }
+
+        done += (uint32_t)count;
+        index += count;
+    }
+}
+
+/*****************************************************************************/
+
+// The range [firstRow, endRow) of JPEG rows, pixels samples wide, that
+// land in the destination window. The other rows need not be decoded.
+
+void dng_lossless_decoder::DestinationRows(uint32_t pixels, int64_t& firstRow, int64_t& endRow) const {
+    const int64_t rowSamples = fOutput.rowSamples ? fOutput.rowSamples : pixels;
+
+    firstRow = std::max<int64_t>(fOutput.offsetY, 0) * rowSamples / pixels;
+    endRow = (std::max<int64_t>((int64_t)fOutput.offsetY + fOutput.height, 0) * rowSamples + pixels - 1) / pixels;
 }
 
 /*****************************************************************************/
@@ -1545,18 +1864,7 @@ void dng_lossless_decoder::DecodeFirstRow(MCU* curRowBuf) {
 
         // Section F.2.2.1: decode the difference
 
-        int32_t d = 0;
-
-        int32_t s = HuffDecode(dctbl);
-
-        if (s) {
-            if (s == 16 && !fBug16) {
-                d = -32768;
-            } else {
-                d = get_bits(s);
-                HuffExtend(d, s);
-            }
-        }
+        int32_t d = DecodeDifference(dctbl, info.dcLookupTblPtrs[compptr->dcTblNo]);
 
         // Add the predictor to the difference.
 
@@ -1580,18 +1888,7 @@ void dng_lossless_decoder::DecodeFirstRow(MCU* curRowBuf) {
 
             // Section F.2.2.1: decode the difference
 
-            int32_t d = 0;
-
-            int32_t s = HuffDecode(dctbl);
-
-            if (s) {
-                if (s == 16 && !fBug16) {
-                    d = -32768;
-                } else {
-                    d = get_bits(s);
-                    HuffExtend(d, s);
-                }
-            }
+            int32_t d = DecodeDifference(dctbl, info.dcLookupTblPtrs[compptr->dcTblNo]);
 
             // Add the predictor to the difference.
 
@@ -1642,8 +1939,10 @@ void dng_lossless_decoder::DecodeImage() {
     // Precompute the decoding table for each table.
 
     HuffmanTable* ht[4];
+    const int32_t* lt[4];
 
     memset(ht, 0, sizeof(ht));
+    memset(lt, 0, sizeof(lt));
 
     for (int32_t curComp = 0; curComp < compsInScan; curComp++) {
         int32_t ci = info.MCUmembership[curComp];
@@ -1651,6 +1950,7 @@ void dng_lossless_decoder::DecodeImage() {
         JpegComponentInfo* compptr = info.curCompInfo[ci];
 
         ht[curComp] = info.dcHuffTblPtrs[compptr->dcTblNo];
+        lt[curComp] = info.dcLookupTblPtrs[compptr->dcTblNo];
     }
 
     MCU* prevRowBuf = mcuROW1;
@@ -1982,6 +2282,16 @@ void dng_lossless_decoder::DecodeImage() {
 
 #endif
 
+    // Rows past the end of the destination window are not decoded,
+    // the stream is left in the middle of the scan.
+
+    if (fOutput.data) {
+        int64_t firstRow, endRow;
+        DestinationRows(numCOL * compsInScan, firstRow, endRow);
+
+        numROW = (int32_t)std::clamp<int64_t>(endRow - fFirstRow, 1, numROW);
+    }
+
     // Decode the first row of image. Output the row and
     // turn this row into a previous row for later predictor
     // calculation.
@@ -2018,18 +2328,7 @@ void dng_lossless_decoder::DecodeImage() {
         for (int32_t curComp = 0; curComp < compsInScan; curComp++) {
             // Section F.2.2.1: decode the difference
 
-            int32_t d = 0;
-
-            int32_t s = HuffDecode(ht[curComp]);
-
-            if (s) {
-                if (s == 16 && !fBug16) {
-                    d = -32768;
-                } else {
-                    d = get_bits(s);
-                    HuffExtend(d, s);
-                }
-            }
+            int32_t d = DecodeDifference(ht[curComp], lt[curComp]);
 
             // First column of row above is predictor for first column.
 
@@ -2050,35 +2349,9 @@ void dng_lossless_decoder::DecodeImage() {
             int32_t prev1 = dPtr[-1];
 
             for (int32_t col = 1; col < numCOL; col++) {
-                int32_t s = HuffDecode(ht[0]);
-
-                if (s) {
-                    int32_t d;
-
-                    if (s == 16 && !fBug16) {
-                        d = -32768;
-                    } else {
-                        d = get_bits(s);
-                        HuffExtend(d, s);
-                    }
-
-                    prev0 += d;
-                }
-
-                s = HuffDecode(ht[1]);
+                prev0 += DecodeDifference(ht[0], lt[0]);
 
-                if (s) {
-                    int32_t d;
-
-                    if (s == 16 && !fBug16) {
-                        d = -32768;
-                    } else {
-                        d = get_bits(s);
-                        HuffExtend(d, s);
-                    }
-
-                    prev1 += d;
-                }
+                prev1 += DecodeDifference(ht[1], lt[1]);
 
                 dPtr[0] = (uint16_t)prev0;
                 dPtr[1] = (uint16_t)prev1;
@@ -2093,18 +2366,7 @@ void dng_lossless_decoder::DecodeImage() {
                 for (int32_t curComp = 0; curComp < compsInScan; curComp++) {
                     // Section F.2.2.1: decode the difference
 
-                    int32_t d = 0;
-
-                    int32_t s = HuffDecode(ht[curComp]);
-
-                    if (s) {
-                        if (s == 16 && !fBug16) {
-                            d = -32768;
-                        } else {
-                            d = get_bits(s);
-                            HuffExtend(d, s);
-                        }
-                    }
+                    int32_t d = DecodeDifference(ht[curComp], lt[curComp]);
 
                     // Predict the pixel value.
 
@@ -2140,7 +2402,181 @@ void dng_lossless_decoder::StartRead(uint32_t& imageWidth, uint32_t& imageHeight
 
 /*****************************************************************************/
 
-void dng_lossless_decoder::FinishRead() { DecodeImage(); }
+/*
+ *--------------------------------------------------------------
+ *
+ * FindRestartSegments --
+ *
+ *    Scan the entropy coded data following the SOS marker for
+ *    RSTn markers, recording the start offset of each restart
+ *    interval. The stream position is left unchanged.
+ *
+ * Results:
+ *    true if the number of restart intervals matches the image
+ *    height, false if the data can not be split.
+ *
+ * Side effects:
+ *    None.
+ *
+ *--------------------------------------------------------------
+ */
+
+bool dng_lossless_decoder::FindRestartSegments(std::vector<size_t>& segmentStarts) {
+    const uint8_t* data = fStream->Data();
+    const size_t length = fStream->Length();
+
+    const int32_t segmentCount = (info.imageHeight + info.restartInRows - 1) / info.restartInRows;
+
+    segmentStarts.clear();
+    segmentStarts.reserve(segmentCount + 1);
+    segmentStarts.push_back(fStream->Position());
+
+    int32_t nextRestartNum = 0;
+
+    size_t i = fStream->Position();
+
+    while (i + 1 < length) {
+        if (data[i] != 0xFF) {
+            i++;
+            continue;
+        }
+
+        uint8_t c = data[i + 1];
+
+        if (c == 0) {
+            // Stuffed zero byte
+            i += 2;
+        } else if (c == 0xFF) {
+            // Fill byte, the marker code follows
+            i++;
+        } else if (c >= M_RST0 && c <= M_RST7) {
+            if (c != M_RST0 + nextRestartNum) {
+                ThrowBadFormat();
+            }
+            nextRestartNum = (nextRestartNum + 1) & 7;
+
+            i += 2;
+            segmentStarts.push_back(i);
+        } else {
+            // Any other marker ends the scan
+            break;
+        }
+    }
+
+    // The end of the last segment
+    segmentStarts.push_back(i);
+
+    return (int32_t)segmentStarts.size() == segmentCount + 1;
+}
+
+/*****************************************************************************/
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DecodeRestartSegments --
+ *
+ *    Decode the restart intervals of the scan concurrently.
+ *    Restart markers reset both the predictors and the bit
+ *    buffer, so each interval is decoded by an independent
+ *    decoder with its own bit buffer and row buffers, writing
+ *    its rows directly in their final place in the output.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Output rows are written, the stream is positioned at the
+ *    end of the scan.
+ *
+ *--------------------------------------------------------------
+ */
+
+void dng_lossless_decoder::DecodeRestartSegments(int32_t threads) {
+    std::vector<size_t> segmentStarts;
+
+    if (!FindRestartSegments(segmentStarts)) {
+        gls::logging::LogDebug(TAG) << "Unexpected restart marker count, decoding serially" << std::endl;
+
+        DecodeImage();
+
+        return;
+    }
+
+    std::vector<uint16_t> outputBuffer;
+
+    dng_decode_destination destination = fOutput;
+
+    if (!destination.data) {
+        const uint32_t rowSamples = info.imageWidth * info.compsInScan;
+
+        outputBuffer.resize((size_t)rowSamples * info.imageHeight);
+
+        destination = {.data = outputBuffer.data(),
+                       .rowStep = rowSamples,
+                       .width = rowSamples,
+                       .height = (uint32_t)info.imageHeight,
+                       .rowSamples = rowSamples,
+                       .offsetX = 0,
+                       .offsetY = 0};
+    }
+
+    const int32_t segmentCount = (int32_t)segmentStarts.size() - 1;
+
+    // Segments entirely outside of the destination window are skipped.
+
+    int64_t firstRow = 0;
+    int64_t endRow = info.imageHeight;
+
+    if (fOutput.data) {
+        DestinationRows(info.imageWidth * info.compsInScan, firstRow, endRow);
+    }
+
+    parallel_for(segmentCount, threads, [&](int segment) {
+        const int64_t segmentRow = (int64_t)segment * info.restartInRows;
+
+        if (segmentRow + info.restartInRows <= firstRow || segmentRow >= endRow) {
+            return;
+        }
+
+        // Each segment includes its terminating marker, so that the bit
+        // buffer refill stops there as it would at the end of a scan.
+
+        const size_t start = segmentStarts[segment];
+        const size_t end = segment + 1 < segmentCount ? segmentStarts[segment + 1]
+                                                      : std::min(segmentStarts[segment + 1] + 2, fStream->Length());
+
+        dng_stream segmentStream(fStream->Data() + start, end - start);
+
+        dng_lossless_decoder decoder(&segmentStream, destination, fBug16);
+
+        decoder.fFirstRow = segment * info.restartInRows;
+
+        decoder.info = info;
+        decoder.info.imageHeight = std::min(info.restartInRows, info.imageHeight - decoder.fFirstRow);
+        decoder.info.restartInRows = 0;
+        decoder.info.restartRowsToGo = 0;
+
+        decoder.DecoderStructInit();
+        decoder.DecodeImage();
+    });
+
+    if (!fOutput.data) {
+        fSpooler->Spool(outputBuffer.data(), (uint32_t)(outputBuffer.size() * sizeof(uint16_t)));
+    }
+
+    fStream->SetReadPosition(std::min(segmentStarts.back(), fStream->Length() - 1));
+}
+
+/*****************************************************************************/
+
+void dng_lossless_decoder::FinishRead(int32_t threads) {
+    if (threads > 1 && info.restartInRows > 0 && info.imageHeight > info.restartInRows) {
+        DecodeRestartSegments(threads);
+    } else {
+        DecodeImage();
+    }
+}
 
 /*****************************************************************************/
 
@@ -2156,6 +2592,8 @@ class dng_lossless_encoder {
     int32_t fSrcRowStep;
     int32_t fSrcColStep;
 
+    uint32_t fRestartRows;  // Rows per restart interval, 0 = no restart markers.
+
     dng_stream& fStream;
 
     HuffmanTable huffTable[4];
@@ -2167,16 +2605,18 @@ class dng_lossless_encoder {
     uint64_t huffPutBuffer;
     uint64_t huffPutBits;
 
-    // Lookup table for number of bits in an 8 bit value.
+    // Prediction differences of the current row and their bit lengths.
 
-    int numBitsTable[256];
+    std::vector<int16_t> diffBuffer;
+    std::vector<uint8_t> nbitsBuffer;
 
     std::vector<uint8_t> streamBuffer;
     size_t streamBufferOffset;
 
    public:
     dng_lossless_encoder(const uint16_t* srcData, uint32_t srcRows, uint32_t srcCols, uint32_t srcChannels,
-                         uint32_t srcBitDepth, int32_t srcRowStep, int32_t srcColStep, dng_stream& stream);
+                         uint32_t srcBitDepth, int32_t srcRowStep, int32_t srcColStep, dng_stream& stream,
+                         uint32_t restartRows = 0);
 
     void Encode();
 
@@ -2193,11 +2633,9 @@ class dng_lossless_encoder {
 
     int EmitBitsToBuffer(int buffered_bits, uint64_t bit_buffer);
 
-    int EncodeOneDiffToBuffer(int diff, HuffmanTable* dctbl, int buffered_bits, uint64_t& bit_buffer);
-
-    void CountOneDiff(int diff, uint32_t* countTable);
+    int EncodeOneDiffToBuffer(int diff, int nbits, const HuffmanTable* dctbl, int buffered_bits, uint64_t& bit_buffer);
 
-    void EncodeOneDiff(int diff, HuffmanTable* dctbl);
+    void RowDifferences(int32_t row);
 
     void FreqCountSet();
 
@@ -2217,6 +2655,10 @@ class dng_lossless_encoder {
 
     void EmitSos();
 
+    void EmitDri();
+
+    bool IsRestartRow(int32_t row) const { return fRestartRows && row > 0 && row % fRestartRows == 0; }
+
     void WriteFileHeader();
 
     void WriteScanHeader();
@@ -2228,7 +2670,7 @@ class dng_lossless_encoder {
 
 dng_lossless_encoder::dng_lossless_encoder(const uint16_t* srcData, uint32_t srcRows, uint32_t srcCols,
                                            uint32_t srcChannels, uint32_t srcBitDepth, int32_t srcRowStep,
-                                           int32_t srcColStep, dng_stream& stream)
+                                           int32_t srcColStep, dng_stream& stream, uint32_t restartRows)
 
     : fSrcData(srcData),
       fSrcRows(srcRows),
@@ -2237,6 +2679,7 @@ dng_lossless_encoder::dng_lossless_encoder(const uint16_t* srcData, uint32_t src
       fSrcBitDepth(srcBitDepth),
       fSrcRowStep(srcRowStep),
       fSrcColStep(srcColStep),
+      fRestartRows(restartRows < srcRows ? restartRows : 0),
       fStream(stream)
 
       ,
@@ -2247,21 +2690,16 @@ dng_lossless_encoder::dng_lossless_encoder(const uint16_t* srcData, uint32_t src
       streamBufferOffset(0)
 
 {
-    // Initialize number of bits lookup table.
-
-    numBitsTable[0] = 0;
-
-    for (int i = 1; i < 256; i++) {
-        int temp = i;
-        int nbits = 1;
+    // The restart interval is expressed in MCUs and must fit in the DRI marker.
 
-        while (temp >>= 1) {
-            nbits++;
-        }
-
-        numBitsTable[i] = nbits;
+    if ((uint64_t)fRestartRows * srcCols > 0xFFFF) {
+        ThrowOverflow("Restart interval too large: " + std::to_string(fRestartRows) + " rows of " +
+                      std::to_string(srcCols) + " columns");
     }
 
+    diffBuffer.resize(srcCols * srcChannels);
+    nbitsBuffer.resize(srcCols * srcChannels);
+
     // Get an upper bound of the size of encoded output for one chunk
     // of output. Chunks are the headers and then one per row.
     //
@@ -2403,48 +2841,21 @@ void dng_lossless_encoder::FlushBuffer() {
 /*
  *--------------------------------------------------------------
  *
- * CountOneDiff --
+ * RowDifferences --
  *
- *        Count the difference value in countTable.
+ *    Compute the differences between each sample of a row and
+ *    its predictor, together with their bit length (the Huffman
+ *    symbol). The first column is predicted from the row above,
+ *    or from the mid value at the start of the image and of each
+ *    restart interval, the rest of the row from the left sample.
  *
- * Results:
- *        diff is counted in countTable.
- *
- * Side effects:
- *        None.
- *
- *--------------------------------------------------------------
- */
-
-inline void dng_lossless_encoder::CountOneDiff(int diff, uint32_t* countTable) {
-    // Encode the DC coefficient difference per section F.1.2.1
-
-    int temp = diff;
-
-    if (temp < 0) {
-        temp = -temp;
-    }
-
-    // Find the number of bits needed for the magnitude of the coefficient
-
-    int nbits = temp >= 256 ? numBitsTable[temp >> 8] + 8 : numBitsTable[temp & 0xFF];
-
-    // Update count for this bit length
-
-    countTable[nbits]++;
-}
-
-/*****************************************************************************/
-
-/*
- *--------------------------------------------------------------
- *
- * EncodeOneDiff --
- *
- *    Encode a single difference value.
+ *    The loops are written to be vectorized by the compiler: the
+ *    left neighbour of each sample is fSrcChannels samples back,
+ *    and the bit length is read off the exponent of the float
+ *    representation of the difference magnitude.
  *
  * Results:
- *    None.
+ *    diffBuffer and nbitsBuffer hold the row's data.
  *
  * Side effects:
  *    None.
@@ -2452,40 +2863,49 @@ inline void dng_lossless_encoder::CountOneDiff(int diff, uint32_t* countTable) {
  *--------------------------------------------------------------
  */
 
-inline void dng_lossless_encoder::EncodeOneDiff(int diff, HuffmanTable* dctbl) {
-    // Encode the DC coefficient difference per section F.1.2.1
+void dng_lossless_encoder::RowDifferences(int32_t row) {
+    const uint16_t* sPtr = fSrcData + row * fSrcRowStep;
 
-    int temp = diff;
-    int temp2 = diff;
+    const int32_t channels = (int32_t)fSrcChannels;
+    const int32_t samples = (int32_t)(fSrcCols * fSrcChannels);
 
-    if (temp < 0) {
-        temp = -temp;
+    int16_t* __restrict diff = diffBuffer.data();
+    uint8_t* __restrict nbits = nbitsBuffer.data();
 
-        // For a negative input, want temp2 = bitwise complement of
-        // abs (input).     This code assumes we are on a two's complement
-        // machine.
+    // Predictors for the first column.
 
-        temp2--;
+    for (int32_t channel = 0; channel < channels; channel++) {
+        int32_t predictor =
+            (row == 0 || IsRestartRow(row)) ? 1 << (fSrcBitDepth - 1) : sPtr[channel - fSrcRowStep];
+
+        diff[channel] = (int16_t)(sPtr[channel] - predictor);
     }
 
-    // Find the number of bits needed for the magnitude of the coefficient
+    // The rest of the row is predicted by the sample on the left.
 
-    int nbits = temp >= 256 ? numBitsTable[temp >> 8] + 8 : numBitsTable[temp & 0xFF];
+    if (fSrcColStep == channels) {
+        for (int32_t i = channels; i < samples; i++) {
+            diff[i] = (int16_t)(sPtr[i] - sPtr[i - channels]);
+        }
+    } else {
+        for (int32_t col = 1; col < (int32_t)fSrcCols; col++) {
+            const uint16_t* pixel = sPtr + col * fSrcColStep;
 
-    // Emit the Huffman-coded symbol for the number of bits
+            for (int32_t channel = 0; channel < channels; channel++) {
+                diff[col * channels + channel] = (int16_t)(pixel[channel] - pixel[channel - fSrcColStep]);
+            }
+        }
+    }
 
-    EmitBits(dctbl->ehufco[nbits], dctbl->ehufsi[nbits]);
+    // Number of bits needed for the magnitude of each difference, the
+    // float exponent of a positive integer n is floor(log2(n)) + 127.
 
-    // Emit that number of bits of the value, if positive,
-    // or the complement of its magnitude, if negative.
+    for (int32_t i = 0; i < samples; i++) {
+        int32_t magnitude = diff[i] < 0 ? -diff[i] : diff[i];
 
-    // If the number of bits is 16, there is only one possible difference
-    // value (-32786), so the lossless JPEG spec says not to output anything
-    // in that case.  So we only need to output the diference value if
-    // the number of bits is between 1 and 15.
+        int32_t exponent = (int32_t)(std::bit_cast<uint32_t>((float)magnitude) >> 23) - 126;
 
-    if (nbits & 15) {
-        EmitBits(temp2 & (0x0FFFF >> (16 - nbits)), nbits);
+        nbits[i] = (uint8_t)(exponent > 0 ? exponent : 0);
     }
 }
 
@@ -2506,8 +2926,8 @@ inline int dng_lossless_encoder::EmitBitsToBuffer(int buffered_bits, uint64_t bi
 
 /*****************************************************************************/
 
-inline int dng_lossless_encoder::EncodeOneDiffToBuffer(int diff, HuffmanTable* dctbl, int buffered_bits,
-                                                       uint64_t& bit_buffer) {
+inline int dng_lossless_encoder::EncodeOneDiffToBuffer(int diff, int nbits, const HuffmanTable* dctbl,
+                                                       int buffered_bits, uint64_t& bit_buffer) {
     DNG_ASSERT(buffered_bits < 64, "buffered_bits too big(1)");
 
     if (buffered_bits > 32) {
@@ -2516,12 +2936,9 @@ inline int dng_lossless_encoder::EncodeOneDiffToBuffer(int diff, HuffmanTable* d
 
     // Encode the DC coefficient difference per section F.1.2.1
 
-    int temp = diff;
     int temp2 = diff;
 
-    if (temp < 0) {
-        temp = -temp;
-
+    if (diff < 0) {
         // For a negative input, want temp2 = bitwise complement of
         // abs (input).     This code assumes we are on a two's complement
         // machine.
@@ -2529,9 +2946,8 @@ inline int dng_lossless_encoder::EncodeOneDiffToBuffer(int diff, HuffmanTable* d
         temp2--;
     }
 
-    // Find the number of bits needed for the magnitude of the coefficient
-
-    int nbits = temp >= 256 ? numBitsTable[temp >> 8] + 8 : numBitsTable[temp & 0xFF];
+    // The number of bits needed for the magnitude of the coefficient
+    // has been computed by RowDifferences.
 
     // Emit the Huffman-coded symbol for the number of bits
     int bits_bits = dctbl->ehufsi[nbits];
@@ -2582,61 +2998,30 @@ void dng_lossless_encoder::FreqCountSet() {
 
     DNG_ASSERT((int32_t)fSrcRows >= 0, "dng_lossless_encoder::FreqCountSet: fSrcRpws too large.");
 
-    for (int32_t row = 0; row < (int32_t)fSrcRows; row++) {
-        const uint16_t* sPtr = fSrcData + row * fSrcRowStep;
-
-        // Initialize predictors for this row.
-
-        int32_t predictor[4] = {0, 0, 0, 0};
-
-        for (int32_t channel = 0; channel < (int32_t)fSrcChannels; channel++) {
-            if (row == 0)
-                predictor[channel] = 1 << (fSrcBitDepth - 1);
-            else
-                predictor[channel] = sPtr[channel - fSrcRowStep];
-        }
-
-        // Unroll most common case of two channels
-
-        if (fSrcChannels == 2) {
-            int32_t pred0 = predictor[0];
-            int32_t pred1 = predictor[1];
+    const uint32_t samples = fSrcCols * fSrcChannels;
 
-            uint32_t srcCols = fSrcCols;
-            int32_t srcColStep = fSrcColStep;
-
-            for (uint32_t col = 0; col < srcCols; col++) {
-                int32_t pixel0 = sPtr[0];
-                int32_t pixel1 = sPtr[1];
+    for (int32_t row = 0; row < (int32_t)fSrcRows; row++) {
+        RowDifferences(row);
 
-                int16_t diff0 = (int16_t)(pixel0 - pred0);
-                int16_t diff1 = (int16_t)(pixel1 - pred1);
+        const uint8_t* nbits = nbitsBuffer.data();
 
-                CountOneDiff(diff0, freqCount[0]);
-                CountOneDiff(diff1, freqCount[1]);
+        // Unroll most common case of one channel
 
-                pred0 = pixel0;
-                pred1 = pixel1;
+        if (fSrcChannels == 1) {
+            uint32_t* countTable = freqCount[0];
 
-                sPtr += srcColStep;
+            for (uint32_t i = 0; i < samples; i++) {
+                countTable[nbits[i]]++;
             }
         }
 
         // General case.
 
         else {
-            for (uint32_t col = 0; col < fSrcCols; col++) {
+            for (uint32_t i = 0; i < samples; i += fSrcChannels) {
                 for (uint32_t channel = 0; channel < fSrcChannels; channel++) {
-                    int32_t pixel = sPtr[channel];
-
-                    int16_t diff = (int16_t)(pixel - predictor[channel]);
-
-                    CountOneDiff(diff, freqCount[channel]);
-
-                    predictor[channel] = pixel;
+                    freqCount[channel][nbits[i + channel]]++;
                 }
-
-                sPtr += fSrcColStep;
             }
         }
     }
@@ -2663,82 +3048,63 @@ void dng_lossless_encoder::FreqCountSet() {
 void dng_lossless_encoder::HuffEncode() {
     DNG_ASSERT((int32_t)fSrcRows >= 0, "dng_lossless_encoder::HuffEncode: fSrcRows too large.");
 
-    uint64_t bit_buffer = 0;
-    int buffered_bits = 0;
+    uint64_t bit_buffer = huffPutBuffer;
+    int buffered_bits = (int)huffPutBits;
 
-    if (fSrcChannels == 2) {
-        bit_buffer = huffPutBuffer;
-        buffered_bits = (int)huffPutBits;
-    }
+    const uint32_t samples = fSrcCols * fSrcChannels;
 
     for (int32_t row = 0; row < (int32_t)fSrcRows; row++) {
-        const uint16_t* sPtr = fSrcData + row * fSrcRowStep;
-
-        // Initialize predictors for this row.
-
-        int32_t predictor[4] = {0, 0, 0, 0};
-
-        for (int32_t channel = 0; channel < (int32_t)fSrcChannels; channel++) {
-            if (row == 0)
-                predictor[channel] = 1 << (fSrcBitDepth - 1);
-            else
-                predictor[channel] = sPtr[channel - fSrcRowStep];
-        }
+        // Terminate the previous restart interval: pad to a byte boundary and emit the RSTn marker.
 
-        // Unroll most common case of two channels
+        if (IsRestartRow(row)) {
+            huffPutBuffer = bit_buffer;
+            huffPutBits = buffered_bits;
 
-        if (fSrcChannels == 2) {
-            int32_t pred0 = predictor[0];
-            int32_t pred1 = predictor[1];
+            FlushBits();
 
-            uint32_t srcCols = fSrcCols;
-            int32_t srcColStep = fSrcColStep;
+            EmitMarker((JpegMarker)(M_RST0 + ((row / fRestartRows - 1) & 7)));
 
-            for (uint32_t col = 0; col < srcCols; col++) {
-                int32_t pixel0 = sPtr[0];
-                int32_t pixel1 = sPtr[1];
+            bit_buffer = 0;
+            buffered_bits = 0;
+        }
 
-                int16_t diff0 = (int16_t)(pixel0 - pred0);
-                int16_t diff1 = (int16_t)(pixel1 - pred1);
+        RowDifferences(row);
 
-                buffered_bits = EncodeOneDiffToBuffer(diff0, &huffTable[0], buffered_bits, bit_buffer);
-                buffered_bits = EncodeOneDiffToBuffer(diff1, &huffTable[1], buffered_bits, bit_buffer);
+        const int16_t* diff = diffBuffer.data();
+        const uint8_t* nbits = nbitsBuffer.data();
 
-                pred0 = pixel0;
-                pred1 = pixel1;
+        // Unroll most common cases of one and two channels
 
-                sPtr += srcColStep;
+        if (fSrcChannels == 1) {
+            for (uint32_t i = 0; i < samples; i++) {
+                buffered_bits = EncodeOneDiffToBuffer(diff[i], nbits[i], &huffTable[0], buffered_bits, bit_buffer);
+            }
+        } else if (fSrcChannels == 2) {
+            for (uint32_t i = 0; i < samples; i += 2) {
+                buffered_bits = EncodeOneDiffToBuffer(diff[i], nbits[i], &huffTable[0], buffered_bits, bit_buffer);
+                buffered_bits =
+                    EncodeOneDiffToBuffer(diff[i + 1], nbits[i + 1], &huffTable[1], buffered_bits, bit_buffer);
             }
-
-            buffered_bits = EmitBitsToBuffer(buffered_bits, bit_buffer);
-
         }
 
         // General case.
 
         else {
-            for (uint32_t col = 0; col < fSrcCols; col++) {
+            for (uint32_t i = 0; i < samples; i += fSrcChannels) {
                 for (uint32_t channel = 0; channel < fSrcChannels; channel++) {
-                    int32_t pixel = sPtr[channel];
-
-                    int16_t diff = (int16_t)(pixel - predictor[channel]);
-
-                    EncodeOneDiff(diff, &huffTable[channel]);
-
-                    predictor[channel] = pixel;
+                    buffered_bits = EncodeOneDiffToBuffer(diff[i + channel], nbits[i + channel], &huffTable[channel],
+                                                          buffered_bits, bit_buffer);
                 }
-
-                sPtr += fSrcColStep;
             }
         }
 
+        buffered_bits = EmitBitsToBuffer(buffered_bits, bit_buffer);
+
         FlushBuffer();
     }
 
-    if (fSrcChannels == 2) {
-        huffPutBuffer = bit_buffer;
-        huffPutBits = buffered_bits;
-    }
+    huffPutBuffer = bit_buffer;
+    huffPutBits = buffered_bits;
 
     FlushBits();
 }
@@ -3157,6 +3523,32 @@ void dng_lossless_encoder::EmitSos() {
  *--------------------------------------------------------------
  */
 
+/*
+ *--------------------------------------------------------------
+ *
+ * EmitDri --
+ *
+ *    Emit a DRI marker, with the restart interval in MCUs.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *--------------------------------------------------------------
+ */
+
+void dng_lossless_encoder::EmitDri() {
+    EmitMarker(M_DRI);
+
+    Emit2bytes(4);  // length
+
+    Emit2bytes(fRestartRows * fSrcCols);
+}
+
+/*****************************************************************************/
+
 void dng_lossless_encoder::WriteFileHeader() {
     EmitMarker(M_SOI);  // first the SOI
 
@@ -3188,6 +3580,10 @@ void dng_lossless_encoder::WriteScanHeader() {
         EmitDht(i);
     }
 
+    if (fRestartRows) {
+        EmitDri();
+    }
+
     EmitSos();
 }
 
@@ -3245,8 +3641,8 @@ void dng_lossless_encoder::Encode() {
 /*****************************************************************************/
 
 void DecodeLosslessJPEG(dng_stream& stream, dng_spooler& spooler, uint32_t minDecodedSize, uint32_t maxDecodedSize,
-                        bool bug16, uint64_t endOfData) {
-    dng_lossless_decoder decoder(&stream, &spooler, bug16);
+                        bool bug16, uint64_t endOfData, int threads, bool useLookupTables) {
+    dng_lossless_decoder decoder(&stream, &spooler, bug16, useLookupTables);
 
     uint32_t imageWidth;
     uint32_t imageHeight;
@@ -3260,7 +3656,32 @@ void DecodeLosslessJPEG(dng_stream& stream, dng_spooler& spooler, uint32_t minDe
         ThrowBadFormat();
     }
 
-    decoder.FinishRead();
+    decoder.FinishRead(threads);
+
+    uint64_t streamPos = stream.Position();
+
+    if (streamPos > endOfData) {
+        ThrowBadFormat();
+    }
+}
+
+/*****************************************************************************/
+
+void DecodeLosslessJPEG(dng_stream& stream, const dng_decode_destination& destination, bool bug16, uint64_t endOfData,
+                        int threads) {
+    if (!destination.data) {
+        ThrowProgramError();
+    }
+
+    dng_lossless_decoder decoder(&stream, destination, bug16);
+
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    uint32_t imageChannels;
+
+    decoder.StartRead(imageWidth, imageHeight, imageChannels);
+
+    decoder.FinishRead(threads);
 
     uint64_t streamPos = stream.Position();
 
@@ -3272,8 +3693,10 @@ void DecodeLosslessJPEG(dng_stream& stream, dng_spooler& spooler, uint32_t minDe
 /*****************************************************************************/
 
 void EncodeLosslessJPEG(const uint16_t* srcData, uint32_t srcRows, uint32_t srcCols, uint32_t srcChannels,
-                        uint32_t srcBitDepth, int32_t srcRowStep, int32_t srcColStep, dng_stream& stream) {
-    dng_lossless_encoder encoder(srcData, srcRows, srcCols, srcChannels, srcBitDepth, srcRowStep, srcColStep, stream);
+                        uint32_t srcBitDepth, int32_t srcRowStep, int32_t srcColStep, dng_stream& stream,
+                        uint32_t restartRows) {
+    dng_lossless_encoder encoder(srcData, srcRows, srcCols, srcChannels, srcBitDepth, srcRowStep, srcColStep, stream,
+                                 restartRows);
 
     encoder.Encode();
 }
@@ -22,6 +22,7 @@
 #include <sys/time.h>
 #include <tiffio.h>
 
+#include <atomic>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -32,78 +33,77 @@
 #include "gls_auto_ptr.hpp"
 #include "gls_dng_lossless_jpeg.hpp"
 #include "gls_logging.h"
+#include "gls_mapped_file.hpp"
+#include "gls_parallel.hpp"
+#include "gls_raw_unpack.hpp"
 #include "gls_tiff_metadata.hpp"
 
 static const char* TAG = "TIFF";
 
 namespace gls {
 
-inline static uint16_t swapBytes(uint16_t in) { return ((in & 0xff) << 8) | (in >> 8); }
+static std::atomic<int> dngDecodeThreads = 0;
+static std::atomic<int> dngEncodeThreads = 0;
 
-inline static void unpack12BitsInto16Bits(uint16_t* out, const uint16_t* in, size_t in_size) {
-    for (int i = 0; i < in_size; i += 3) {
-        uint16_t in0 = swapBytes(in[i]);
-        uint16_t in1 = swapBytes(in[i + 1]);
-        uint16_t in2 = swapBytes(in[i + 2]);
+void set_dng_decode_threads(int threads) { dngDecodeThreads = std::max(threads, 0); }
 
-        *out++ = in0 >> 4;
-        *out++ = ((in0 << 8) & 0xfff) | (in1 >> 8);
-        *out++ = ((in1 << 4) & 0xfff) | (in2 >> 12);
-        *out++ = in2 & 0xfff;
-    }
-}
-
-inline static void unpack14BitsInto16Bits(uint16_t* out, const uint16_t* in, size_t in_size) {
-    for (int i = 0; i < in_size; i += 7) {
-        uint16_t in0 = swapBytes(in[i]);
-        uint16_t in1 = swapBytes(in[i + 1]);
-        uint16_t in2 = swapBytes(in[i + 2]);
-        uint16_t in3 = swapBytes(in[i + 3]);
-        uint16_t in4 = swapBytes(in[i + 4]);
-        uint16_t in5 = swapBytes(in[i + 5]);
-        uint16_t in6 = swapBytes(in[i + 6]);
-
-        *out++ = in0 >> 2;
-        *out++ = ((in0 << 12) & 0x3fff) | (in1 >> 4);
-        *out++ = ((in1 << 10) & 0x3fff) | (in2 >> 6);
-        *out++ = ((in2 << 8) & 0x3fff) | (in3 >> 8);
-        *out++ = ((in3 << 6) & 0x3fff) | (in4 >> 10);
-        *out++ = ((in4 << 4) & 0x3fff) | (in5 >> 12);
-        *out++ = ((in5 << 2) & 0x3fff) | (in6 >> 14);
-        *out++ = (in6 & 0x3fff);
-    }
-}
-
-// TODO: finish building a general unpacking function
-/*
-inline static void unpackTo16Bits(uint16_t *out, const uint16_t *in, int bitspersample, size_t in_size) {
-    int gcd = findGcd(16, bitspersample);
+int dng_decode_threads() { return dngDecodeThreads > 0 ? (int)dngDecodeThreads : hardware_threads(); }
 
-    gls::logging::LogDebug(TAG) << "gcd: " << gcd << std::endl;
+void set_dng_encode_threads(int threads) { dngEncodeThreads = std::max(threads, 0); }
 
-    int inputWords = bitspersample / gcd;
-    int outputWords = 16 / gcd;
+int dng_encode_threads() { return dngEncodeThreads > 0 ? (int)dngEncodeThreads : hardware_threads(); }
 
-    gls::logging::LogDebug(TAG) << "inputWords: " << inputWords << ", outputWords: " << outputWords << std::endl;
+// Packed TIFF sample layouts, rows start on a byte boundary
+static bool isPackedBitDepth(int bitspersample) {
+    return bitspersample == 10 || bitspersample == 12 || bitspersample == 14;
+}
 
-    uint16_t inputBuffer[inputWords];
-    uint16_t outputBuffer[outputWords];
+static raw_packing tiffPacking(int bitspersample) {
+    return bitspersample == 10 ? raw_packing::msb_10 : bitspersample == 12 ? raw_packing::msb_12 : raw_packing::msb_14;
+}
 
-    for (int i = 0; i < in_size; i += inputWords) {
-        for (int j = 0; j < inputWords; j++) {
-            inputBuffer[j] = swapBytes(in[i + j]);
+// Compressed bytes of a strip or tile. When the file is memory mapped this is a view of the mapped file, otherwise the
+// data is read into storage.
+static std::span<uint8_t> readRawStrile(TIFF* tif, const mapped_file* mapped, uint32_t strile,
+                                        std::vector<uint8_t>* storage) {
+    const uint64_t byteCount = TIFFGetStrileByteCount(tif, strile);
+    if (mapped) {
+        if (uint8_t* data = mapped->view(TIFFGetStrileOffset(tif, strile), byteCount)) {
+            return std::span(data, byteCount);
         }
+    }
 
-        int shift = 16 - bitspersample;
-        for (int k = 0; k < outputWords; k++) {
+    storage->resize(byteCount);
+    const bool tiled = TIFFIsTiled(tif);
+    tmsize_t bytes = tiled ? TIFFReadRawTile(tif, strile, storage->data(), (tmsize_t)storage->size())
+                           : TIFFReadRawStrip(tif, strile, storage->data(), (tmsize_t)storage->size());
+    if (bytes < 0) {
+        throw std::runtime_error(std::string("Failed to read TIFF ") + (tiled ? "tile " : "strip ") +
+                                 std::to_string(strile));
+    }
+    storage->resize(bytes);
+    return std::span(storage->data(), storage->size());
+}
 
-        }
+// Intersect the optional region of interest with the width x height image, the result is never empty
+static rectangle clipRegionOfInterest(const rectangle* roi, int width, int height) {
+    if (!roi) {
+        return rectangle(0, 0, width, height);
     }
+    const int x0 = std::max(roi->x, 0);
+    const int y0 = std::max(roi->y, 0);
+    const int x1 = std::min(roi->x + roi->width, width);
+    const int y1 = std::min(roi->y + roi->height, height);
+    if (x1 <= x0 || y1 <= y0) {
+        throw std::runtime_error("Region of interest outside of the image.");
+    }
+    return rectangle(x0, y0, x1 - x0, y1 - y0);
 }
-*/
 
+// Strips which don't intersect crop, in file coordinates, are skipped
 static void readTiffImageData(TIFF* tif, int width, int height, int tiff_bitspersample, int tiff_samplesperpixel,
-                              tiff_strip_procesor process_tiff_strip) {
+                              tiff_strip_procesor process_tiff_strip, const rectangle& crop,
+                              const mapped_file* mapped = nullptr) {
     size_t stripSize = TIFFStripSize(tif);
     auto_ptr<uint8_t> tiffbuf((uint8_t*)_TIFFmalloc(stripSize), [](uint8_t* tiffbuf) { _TIFFfree(tiffbuf); });
 
@@ -114,38 +114,62 @@ static void readTiffImageData(TIFF* tif, int width, int height, int tiff_bitsper
 
     gls::logging::LogDebug(TAG) << "stripSize: " << stripSize << ", width: " << width << std::endl;
 
+    // Uncompressed strips can be used in place from the mapped file, unless libtiff would have to swap their bytes
+    uint16_t compression = COMPRESSION_NONE;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compression);
+    uint16_t fillorder = FILLORDER_MSB2LSB;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_FILLORDER, &fillorder);
+    const bool mappedStrips = mapped && compression == COMPRESSION_NONE && fillorder == FILLORDER_MSB2LSB &&
+                              !(tiff_bitspersample == 16 && TIFFIsByteSwapped(tif));
+
     if (tiffbuf) {
         uint32_t rowsperstrip = 0;
         TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
 
         for (uint32_t row = 0; row < height; row += rowsperstrip) {
             uint32_t nrow = (row + rowsperstrip > height) ? (height - row) : rowsperstrip;
+            if ((int)(row + nrow) <= crop.y || (int)row >= crop.y + crop.height) {
+                continue;
+            }
             tstrip_t strip = TIFFComputeStrip(tif, row, 0);
 
-            if ((TIFFReadEncodedStrip(tif, strip, tiffbuf, -1)) < 0) {
-                throw std::runtime_error("Failed to encode TIFF strip.");
+            uint8_t* stripData = nullptr;
+            if (mappedStrips) {
+                const uint64_t requiredBytes = TIFFVStripSize(tif, nrow);
+                if (TIFFGetStrileByteCount(tif, strip) >= requiredBytes) {
+                    stripData = mapped->view(TIFFGetStrileOffset(tif, strip), requiredBytes);
+                }
+                // 16 bit samples are accessed as such, make sure they are aligned
+                if (tiff_bitspersample == 16 && ((uintptr_t)stripData & 1)) {
+                    stripData = nullptr;
+                }
+            }
+            if (!stripData) {
+                if ((TIFFReadEncodedStrip(tif, strip, tiffbuf, -1)) < 0) {
+                    throw std::runtime_error("Failed to encode TIFF strip.");
+                }
+                stripData = tiffbuf;
             }
 
-            if (tiff_bitspersample == 12) {
-                unpack12BitsInto16Bits((uint16_t*)decodedBuffer.get(), (uint16_t*)tiffbuf.get(),
-                                       stripSize / sizeof(uint16_t));
-
-                process_tiff_strip(/* tiff_bitspersample=*/16, tiff_samplesperpixel, row,
-                                   /*strip_width=*/width, /*strip_height=*/nrow, /*crop_x=*/0, /*crop_y=*/0,
-                                   decodedBuffer);
-            } else if (tiff_bitspersample == 14) {
-                unpack14BitsInto16Bits((uint16_t*)decodedBuffer.get(), (uint16_t*)tiffbuf.get(),
-                                       stripSize / sizeof(uint16_t));
+            if (isPackedBitDepth(tiff_bitspersample)) {
+                const tmsize_t scanlineSize = TIFFScanlineSize(tif);
+                const size_t rowSamples = (size_t)width * tiff_samplesperpixel;
+                for (uint32_t y = 0; y < nrow; y++) {
+                    unpack_raw(tiffPacking(tiff_bitspersample), stripData + y * scanlineSize,
+                               (uint16_t*)decodedBuffer.get() + y * rowSamples, rowSamples);
+                }
 
                 process_tiff_strip(/* tiff_bitspersample=*/16, tiff_samplesperpixel, row,
-                                   /*strip_width=*/width, /*strip_height=*/nrow, /*crop_x=*/0, /*crop_y=*/0,
+                                   /*strip_width=*/width, /*strip_height=*/nrow, /*crop_x=*/crop.x, /*crop_y=*/crop.y,
                                    decodedBuffer);
             } else if (tiff_bitspersample == 16) {
                 process_tiff_strip(/* tiff_bitspersample=*/16, tiff_samplesperpixel, row,
-                                   /*strip_width=*/width, /*strip_height=*/nrow, /*crop_x=*/0, /*crop_y=*/0, tiffbuf);
+                                   /*strip_width=*/width, /*strip_height=*/nrow, /*crop_x=*/crop.x, /*crop_y=*/crop.y,
+                                   stripData);
             } else if (tiff_bitspersample == 8) {
                 process_tiff_strip(/* tiff_bitspersample=*/8, tiff_samplesperpixel, row,
-                                   /*strip_width=*/width, /*strip_height=*/nrow, /*crop_x=*/0, /*crop_y=*/0, tiffbuf);
+                                   /*strip_width=*/width, /*strip_height=*/nrow, /*crop_x=*/crop.x, /*crop_y=*/crop.y,
+                                   stripData);
             } else {
                 throw std::runtime_error("tiff_bitspersample " + std::to_string(tiff_bitspersample) +
                                          " not supported.");
@@ -190,13 +214,16 @@ static void setTiffErrorHandler() {
 }
 
 void read_tiff_file(const std::string& filename, int pixel_channels, int pixel_bit_depth, tiff_metadata* metadata,
-                    std::function<bool(int width, int height)> image_allocator,
-                    tiff_strip_procesor process_tiff_strip) {
+                    std::function<bool(int width, int height)> image_allocator, tiff_strip_procesor process_tiff_strip,
+                    const rectangle* roi) {
     setTiffErrorHandler();
 
     auto_ptr<TIFF> tif(TIFFOpen(filename.c_str(), "r"), [](TIFF* tif) { TIFFClose(tif); });
 
     if (tif) {
+        // libtiff parses the directory, the strips are read straight from the mapped file
+        const mapped_file mappedFile(filename);
+
         uint32_t width, height;
         TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
         TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
@@ -212,13 +239,16 @@ void read_tiff_file(const std::string& filename, int pixel_channels, int pixel_b
 
         uint16_t tiff_bitspersample;
         TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &tiff_bitspersample);
-        if ((tiff_bitspersample != 8 && tiff_bitspersample != 16)) {
+        if (tiff_bitspersample != 8 && tiff_bitspersample != 16 && !isPackedBitDepth(tiff_bitspersample)) {
             throw std::runtime_error("can not read sample with " + std::to_string(tiff_bitspersample) + " bits depth");
         }
 
-        auto allocation_successful = image_allocator(width, height);
+        const auto crop = clipRegionOfInterest(roi, width, height);
+
+        auto allocation_successful = image_allocator(crop.width, crop.height);
         if (allocation_successful) {
-            readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, process_tiff_strip);
+            readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, process_tiff_strip, crop,
+                              mappedFile ? &mappedFile : nullptr);
         } else {
             throw std::runtime_error("Couldn't allocate image storage");
         }
@@ -299,13 +329,18 @@ void write_tiff_file(const std::string& filename, int width, int height, int pix
 
 void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bit_depth,
                    gls::tiff_metadata* dng_metadata, gls::tiff_metadata* exif_metadata,
-                   std::function<bool(int width, int height)> image_allocator, tiff_strip_procesor process_tiff_strip) {
+                   std::function<bool(int width, int height)> image_allocator, tiff_strip_procesor process_tiff_strip,
+                   tiff_destination destination, const rectangle* roi) {
     setTiffErrorHandler();
     augment_libtiff_with_custom_tags();
 
     auto_ptr<TIFF> tif(TIFFOpen(filename.c_str(), "r"), [](TIFF* tif) { TIFFClose(tif); });
 
     if (tif) {
+        // libtiff parses the directories, the strips and tiles are decoded straight from the mapped file
+        const mapped_file mappedFile(filename);
+        const mapped_file* mapped = mappedFile ? &mappedFile : nullptr;
+
         if (dng_metadata) {
             readAllTIFFTags(tif, dng_metadata);
         }
@@ -397,10 +432,25 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
             }
         }
 
+        if (roi) {
+            const auto region = clipRegionOfInterest(roi, image_width, image_height);
+            crop_x += region.x;
+            crop_y += region.y;
+            image_width = region.width;
+            image_height = region.height;
+        }
+
         auto allocation_successful = image_allocator(image_width, image_height);
         if (allocation_successful) {
             gls::logging::LogDebug(TAG) << "TIFFIsTiled: " << TIFFIsTiled(tif) << std::endl;
 
+            // Lossless JPEG data is decoded in place if the destination layout matches the file's
+            size_t destinationRowStep = 0;
+            uint16_t* destinationData = destination && compression == COMPRESSION_JPEG &&
+                                                pixel_channels == tiff_samplesperpixel && pixel_bit_depth == 16
+                                            ? destination(&destinationRowStep)
+                                            : nullptr;
+
             if (TIFFIsTiled(tif)) {
                 uint32_t maxTileWidth, maxTileHeight;
 
@@ -409,50 +459,63 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
                 gls::logging::LogDebug(TAG)
                     << "tileWidth: " << maxTileWidth << ", tileHeight: " << maxTileHeight << std::endl;
 
-                tmsize_t tileSize = TIFFTileSize(tif);
                 uint32_t tileCount = TIFFNumberOfTiles(tif);
                 uint32_t tileCountX = (width + maxTileWidth - 1) / maxTileWidth;
-                auto_ptr<uint16_t> tiffbuf((uint16_t*)_TIFFmalloc(tileSize), [](uint16_t* buf) { _TIFFfree(buf); });
 
-                auto_ptr<uint16_t> imagebuf(
-                    (uint16_t*)_TIFFmalloc(tiff_samplesperpixel * width * height * sizeof(uint16_t)),
-                    [](uint16_t* buf) { _TIFFfree(buf); });
+                // Only the tiles intersecting the crop rectangle are read and decoded
+                std::vector<uint32_t> tiles;
+                for (uint32_t tile = 0; tile < tileCount; tile++) {
+                    const int tileX = maxTileWidth * (tile % tileCountX);
+                    const int tileY = maxTileHeight * (tile / tileCountX);
+                    if (tileX < crop_x + (int)image_width && tileX + (int)maxTileWidth > crop_x &&
+                        tileY < crop_y + (int)image_height && tileY + (int)maxTileHeight > crop_y) {
+                        tiles.push_back(tile);
+                    }
+                }
 
                 if (compression == COMPRESSION_JPEG) {
-                    for (uint32_t tile = 0; tile < tileCount; tile++) {
+                    // libtiff handles are not thread safe, locate all the compressed tiles up front. Unless the
+                    // file couldn't be mapped, this doesn't copy any data.
+                    std::vector<std::vector<uint8_t>> rawTileStorage(tileCount);
+                    std::vector<std::span<uint8_t>> rawTiles(tileCount);
+                    for (uint32_t tile : tiles) {
+                        rawTiles[tile] = readRawStrile(tif, mapped, tile, &rawTileStorage[tile]);
+                    }
+
+                    // Decode the tiles concurrently, each tile lands directly in its final place in the destination
+                    const uint32_t decodedSize = tiff_samplesperpixel * maxTileWidth * maxTileHeight * sizeof(uint16_t);
+                    parallel_for((int)tiles.size(), dng_decode_threads(), [&](int index) {
+                        const uint32_t tile = tiles[index];
                         uint32_t tileX = maxTileWidth * (tile % tileCountX);
                         uint32_t tileY = maxTileHeight * (tile / tileCountX);
-
-                        uint32_t tileWidth = std::min(tileX + maxTileWidth, width) - tileX;
                         uint32_t tileHeight = std::min(tileY + maxTileHeight, height) - tileY;
 
-                        tmsize_t tileBytes = TIFFReadRawTile(tif, tile, (uint8_t*)tiffbuf.get(), (tsize_t)-1);
-                        if (tileBytes < 0) {
-                            throw std::runtime_error("Failed to read TIFF tile " + std::to_string(tile));
+                        // Used Adobe's version of libjpeg lossless codec
+                        dng_stream stream(rawTiles[tile].data(), rawTiles[tile].size());
+                        if (destinationData) {
+                            // The tile's rows are maxTileWidth wide, the padding is clipped by the destination window
+                            DecodeLosslessJPEG(stream,
+                                               {.data = destinationData,
+                                                .rowStep = destinationRowStep,
+                                                .width = image_width * tiff_samplesperpixel,
+                                                .height = image_height,
+                                                .rowSamples = maxTileWidth * tiff_samplesperpixel,
+                                                .offsetX = (crop_x - (int)tileX) * tiff_samplesperpixel,
+                                                .offsetY = crop_y - (int)tileY},
+                                               false, rawTiles[tile].size());
                         } else {
-                            // Used Adobe's version of libjpeg lossless codec
-                            dng_stream stream((uint8_t*)tiffbuf.get(), tileSize);
                             dng_spooler spooler;
-                            uint32_t decodedSize = maxTileWidth * maxTileHeight * sizeof(uint16_t);
-                            DecodeLosslessJPEG(stream, spooler, tiff_samplesperpixel * decodedSize,
-                                               tiff_samplesperpixel * decodedSize, false, tileSize);
-
-                            uint16_t* tilePixels = (uint16_t*)spooler.data();
-                            for (int y = 0; y < tileHeight; y++) {
-                                for (int x = 0; x < tileWidth; x++) {
-                                    for (int c = 0; c < tiff_samplesperpixel; c++) {
-                                        imagebuf[tiff_samplesperpixel * ((tileY + y) * width + tileX + x) + c] =
-                                            tilePixels[tiff_samplesperpixel * (y * maxTileWidth + x) + c];
-                                    }
-                                }
-                            }
+                            DecodeLosslessJPEG(stream, spooler, decodedSize, decodedSize, false,
+                                               rawTiles[tile].size());
+
+                            // The output of the JPEG decoder is always 16 bits, the tile's rows are maxTileWidth wide
+                            process_tiff_strip(/*tiff_bitspersample=*/16, tiff_samplesperpixel, /*row=*/tileY,
+                                               /*strip_width=*/maxTileWidth, /*strip_height=*/tileHeight,
+                                               /*crop_x=*/crop_x - (int)tileX, /*crop_y=*/crop_y,
+                                               (uint8_t*)spooler.data());
                         }
-                    }
-
-                    // The output of the JPEG decoder is always 16 bits
-                    process_tiff_strip(/*tiff_bitspersample=*/16, tiff_samplesperpixel, 0,
-                                       /*strip_width=*/width, /*strip_height=*/height,
-                                       /*crop_x=*/crop_x, /*crop_y=*/crop_y, (uint8_t*)imagebuf.get());
+                        std::vector<uint8_t>().swap(rawTileStorage[tile]);
+                    });
                 } else {
                     throw std::runtime_error("Not implemented yet...");
                 }
@@ -460,43 +523,45 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
                 if (compression == COMPRESSION_JPEG) {
                     // DNG data is losslessly compressed
 
-                    uint32_t* stripbytecounts = 0;
-                    TIFFGetField(tif, TIFFTAG_STRIPBYTECOUNTS, &stripbytecounts);
-                    gls::logging::LogDebug(TAG) << "stripbytecounts: " << stripbytecounts[0] << std::endl;
-
-                    // We only expect one single big strip, but you never know
-                    uint32_t stripsize = stripbytecounts[0];
-
+                    // We only expect one single big strip
                     if (TIFFNumberOfStrips(tif) != 1) {
                         throw std::runtime_error("Only one TIFF strip expected for compressed DNG files.");
                     }
 
-                    tdata_t tiffbuf = _TIFFmalloc(stripsize);
-                    for (int strip = 0; strip < TIFFNumberOfStrips(tif); strip++) {
-                        if (stripbytecounts[strip] > stripsize) {
-                            tiffbuf = _TIFFrealloc(tiffbuf, stripbytecounts[strip]);
-                            stripsize = stripbytecounts[strip];
-                        }
-                        if (TIFFReadRawStrip(tif, strip, tiffbuf, stripbytecounts[strip]) < 0) {
-                            throw std::runtime_error("Failed to read compressed TIFF strip.");
-                        }
-
-                        // Used Adobe's version of libjpeg lossless codec
-                        dng_stream stream((uint8_t*)tiffbuf, stripsize);
+                    std::vector<uint8_t> rawStripStorage;
+                    const auto rawStrip = readRawStrile(tif, mapped, /*strile=*/0, &rawStripStorage);
+                    const size_t stripsize = rawStrip.size();
+                    gls::logging::LogDebug(TAG) << "stripsize: " << stripsize << std::endl;
+
+                    // Used Adobe's version of libjpeg lossless codec, strips with restart markers are decoded in
+                    // parallel
+                    dng_stream stream(rawStrip.data(), stripsize);
+                    if (destinationData) {
+                        DecodeLosslessJPEG(stream,
+                                           {.data = destinationData,
+                                            .rowStep = destinationRowStep,
+                                            .width = image_width * tiff_samplesperpixel,
+                                            .height = image_height,
+                                            .rowSamples = width * tiff_samplesperpixel,
+                                            .offsetX = crop_x * tiff_samplesperpixel,
+                                            .offsetY = crop_y},
+                                           false, stripsize, dng_decode_threads());
+                    } else {
                         dng_spooler spooler;
                         uint32_t decodedSize = width * height * sizeof(uint16_t);
-                        DecodeLosslessJPEG(stream, spooler, decodedSize, decodedSize, false, stripsize);
+                        DecodeLosslessJPEG(stream, spooler, decodedSize, decodedSize, false, stripsize,
+                                           dng_decode_threads());
 
                         // The output of the JPEG decoder is always 16 bits
                         process_tiff_strip(/*tiff_bitspersample=*/16, tiff_samplesperpixel, /*row=*/0,
                                            /*strip_width=*/width, /*strip_height=*/height,
                                            /*crop_x=*/crop_x, /*crop_y=*/crop_y, (uint8_t*)spooler.data());
                     }
-                    _TIFFfree(tiffbuf);
                 } else {
                     // No compreession, read as a plain TIFF file
 
-                    readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, process_tiff_strip);
+                    readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, process_tiff_strip,
+                                      rectangle(crop_x, crop_y, image_width, image_height), mapped);
                 }
             }
         }
@@ -508,80 +573,161 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
     }
 }
 
-void write_dng_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
-                    tiff_compression compression, const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata,
-                    std::function<uint16_t*(int row)> row_pointer) {
-    setTiffErrorHandler();
-    augment_libtiff_with_custom_tags();
-
+static void checkDngCompression(tiff_compression compression) {
     if (compression != COMPRESSION_NONE && compression != COMPRESSION_JPEG &&
         compression != COMPRESSION_ADOBE_DEFLATE) {
         throw std::runtime_error(
             "Only lossles JPEG and ADOBE_DEFLATE compression schemes are supported for DNG files. (" +
             std::to_string(compression) + ")");
     }
+}
 
-    auto_ptr<TIFF> tif(TIFFOpen(filename.c_str(), "w"), [](TIFF* tif) { TIFFClose(tif); });
+static void writeDngTags(TIFF* tif, int width, int height, tiff_compression compression,
+                         const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata) {
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+
+    TIFFSetField(tif, TIFFTAG_DNGVERSION, "\01\04\00\00");
+    TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION, "\01\03\00\00");
+    TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+
+    uint16_t orientation = ORIENTATION_TOPLEFT;
+    if (dng_metadata) {
+        const auto entry = dng_metadata->find(TIFFTAG_ORIENTATION);
+        if (entry != dng_metadata->end()) {
+            orientation = std::get<uint16_t>(entry->second);
+        }
+    }
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, orientation);
 
-    if (tif) {
-        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
-        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
+    TIFFSetField(tif, TIFFTAG_CFALAYOUT, 1);  // Rectangular (or square) layout
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
 
-        TIFFSetField(tif, TIFFTAG_DNGVERSION, "\01\04\00\00");
-        TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION, "\01\03\00\00");
-        TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
-        TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
-        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+    TIFFSetField(tif, TIFFTAG_MAKE, "Glass");
+    TIFFSetField(tif, TIFFTAG_UNIQUECAMERAMODEL, "Glass 1");
 
-        uint16_t orientation = ORIENTATION_TOPLEFT;
-        if (dng_metadata) {
-            const auto entry = dng_metadata->find(TIFFTAG_ORIENTATION);
-            if (entry != dng_metadata->end()) {
-                orientation = std::get<uint16_t>(entry->second);
-            }
-        }
-        TIFFSetField(tif, TIFFTAG_ORIENTATION, orientation);
+    if (dng_metadata) {
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_DATETIME);
 
-        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
-        TIFFSetField(tif, TIFFTAG_CFALAYOUT, 1);  // Rectangular (or square) layout
-        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
-        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_CFAREPEATPATTERNDIM);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_CFAPATTERN);
 
-        TIFFSetField(tif, TIFFTAG_MAKE, "Glass");
-        TIFFSetField(tif, TIFFTAG_UNIQUECAMERAMODEL, "Glass 1");
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_COLORMATRIX1);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_COLORMATRIX2);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_ASSHOTNEUTRAL);
 
-        if (dng_metadata) {
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_DATETIME);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_CALIBRATIONILLUMINANT1);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_CALIBRATIONILLUMINANT2);
 
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_CFAREPEATPATTERNDIM);
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_CFAPATTERN);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_BLACKLEVELREPEATDIM);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_BLACKLEVEL);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_WHITELEVEL);
 
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_COLORMATRIX1);
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_COLORMATRIX2);
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_ASSHOTNEUTRAL);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_BAYERGREENSPLIT);
+        writeMetadataForTag(tif, dng_metadata, TIFFTAG_BASELINEEXPOSURE);
+    }
+
+    if (exif_metadata) {
+        // Set dummy EXIF tag in original tiff-structure in order to reserve space for final dir_offset value,
+        // which is properly written at the end.
+        uint64_t dir_offset = 0;  // Zero, in case no Custom-IFD is written
+        if (!TIFFSetField(tif, TIFFTAG_EXIFIFD, dir_offset)) {
+            std::cerr << "Can't write TIFFTAG_EXIFIFD." << std::endl;
+        }
+    }
+}
 
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_CALIBRATIONILLUMINANT1);
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_CALIBRATIONILLUMINANT2);
+static void finalizeDngFile(TIFF* tif, const tiff_metadata* exif_metadata) {
+    // Write directory to file
+    TIFFWriteDirectory(tif);
 
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_BLACKLEVELREPEATDIM);
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_BLACKLEVEL);
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_WHITELEVEL);
+    if (exif_metadata) {
+        writeExifMetadata(tif, exif_metadata);
+    }
+}
 
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_BAYERGREENSPLIT);
-            writeMetadataForTag(tif, dng_metadata, TIFFTAG_BASELINEEXPOSURE);
+// TIFF tile dimensions are multiples of 16
+static uint32_t dngTileSize(int tile_size) { return (tile_size + 15) & ~15; }
+
+// Encode a tileSize x tileSize lossless JPEG tile whose origin is at tileData. Edge tiles narrower or shorter than
+// tileSize are padded to full size replicating the last column and row.
+static void encodeDngTile(const uint16_t* tileData, int rowStep, uint32_t tileWidth, uint32_t tileHeight,
+                          uint32_t tileSize, std::vector<uint8_t>* encodedTile) {
+    std::vector<uint16_t> paddedTile;
+    if (tileWidth < tileSize || tileHeight < tileSize) {
+        paddedTile.resize(tileSize * tileSize);
+        for (uint32_t y = 0; y < tileSize; y++) {
+            const uint16_t* source = tileData + std::min(y, tileHeight - 1) * rowStep;
+            uint16_t* destination = paddedTile.data() + y * tileSize;
+            std::copy(source, source + tileWidth, destination);
+            std::fill(destination + tileWidth, destination + tileSize, source[tileWidth - 1]);
         }
+        tileData = paddedTile.data();
+        rowStep = tileSize;
+    }
 
-        if (exif_metadata) {
-            // Set dummy EXIF tag in original tiff-structure in order to reserve space for final dir_offset value,
-            // which is properly written at the end.
-            uint64_t dir_offset = 0;  // Zero, in case no Custom-IFD is written
-            if (!TIFFSetField(tif, TIFFTAG_EXIFIFD, dir_offset)) {
-                std::cerr << "Can't write TIFFTAG_EXIFIFD." << std::endl;
-            }
-        }
+    // Worst case: a 16 bit code and 16 bits of difference for each sample, plus headers
+    encodedTile->resize(tileSize * tileSize * 2 * sizeof(uint16_t) + 4096);
+    dng_stream out_stream(encodedTile->data(), encodedTile->size());
 
-        if (compression == COMPRESSION_JPEG) {
+    EncodeLosslessJPEG(tileData, tileSize, tileSize,
+                       /*srcChannels=*/1, /*srcBitDepth=*/16,  // TODO: reflect the actual bit depth
+                       /*srcRowStep=*/rowStep, /*srcColStep=*/1, out_stream);
+
+    encodedTile->resize(out_stream.Position());
+}
+
+void write_dng_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
+                    tiff_compression compression, const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata,
+                    std::function<uint16_t*(int row)> row_pointer, int tile_size) {
+    setTiffErrorHandler();
+    augment_libtiff_with_custom_tags();
+
+    checkDngCompression(compression);
+
+    auto_ptr<TIFF> tif(TIFFOpen(filename.c_str(), "w"), [](TIFF* tif) { TIFFClose(tif); });
+
+    if (tif) {
+        writeDngTags(tif, width, height, compression, dng_metadata, exif_metadata);
+
+        if (compression == COMPRESSION_JPEG && tile_size > 0) {
+            const uint32_t tileSize = dngTileSize(tile_size);
+            const uint32_t tilesAcross = (width + tileSize - 1) / tileSize;
+            const uint32_t tileCount = tilesAcross * ((height + tileSize - 1) / tileSize);
+            const int rowStep = height > 1 ? (int)(row_pointer(1) - row_pointer(0)) : width;
+
+            TIFFSetField(tif, TIFFTAG_TILEWIDTH, tileSize);
+            TIFFSetField(tif, TIFFTAG_TILELENGTH, tileSize);
+
+            // Encode the tiles concurrently, each with its own optimized Huffman tables
+            std::vector<std::vector<uint8_t>> encodedTiles(tileCount);
+            parallel_for(tileCount, dng_encode_threads(), [&](int tile) {
+                const uint32_t tileX = tileSize * (tile % tilesAcross);
+                const uint32_t tileY = tileSize * (tile / tilesAcross);
+                const uint32_t tileWidth = std::min(tileX + tileSize, (uint32_t)width) - tileX;
+                const uint32_t tileHeight = std::min(tileY + tileSize, (uint32_t)height) - tileY;
+
+                encodeDngTile(row_pointer(tileY) + tileX, rowStep, tileWidth, tileHeight, tileSize,
+                              &encodedTiles[tile]);
+                encodedTiles[tile].shrink_to_fit();
+            });
+
+            // libtiff is not thread safe, write the tiles in order
+            size_t compressedBytes = 0;
+            for (uint32_t tile = 0; tile < tileCount; tile++) {
+                if (TIFFWriteRawTile(tif, tile, encodedTiles[tile].data(), encodedTiles[tile].size()) < 0) {
+                    throw std::runtime_error("Failed to write TIFF tile " + std::to_string(tile));
+                }
+                compressedBytes += encodedTiles[tile].size();
+            }
+            gls::logging::LogDebug(TAG) << "Wrote " << compressedBytes << " compressed image bytes in " << tileCount
+                                        << " tiles." << std::endl;
+        } else if (compression == COMPRESSION_JPEG) {
             TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, height);
 
             std::vector<uint16_t> outputBuffer(height * width);
@@ -599,12 +745,80 @@ void write_dng_file(const std::string& filename, int width, int height, int pixe
             writeTiffImageData(tif, width, height, pixel_channels, pixel_bit_depth, row_pointer);
         }
 
-        // Write directory to file
-        TIFFWriteDirectory(tif);
+        finalizeDngFile(tif, exif_metadata);
+    } else {
+        throw std::runtime_error("Couldn't open DNG file for writing.");
+    }
+}
+
+void write_dng_file_streaming(const std::string& filename, int width, int height, tiff_compression compression,
+                              const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata,
+                              dng_band_producer produce_band, int band_size) {
+    setTiffErrorHandler();
+    augment_libtiff_with_custom_tags();
+
+    checkDngCompression(compression);
+
+    if (band_size <= 0) {
+        throw std::runtime_error("Invalid DNG band size: " + std::to_string(band_size));
+    }
+
+    auto_ptr<TIFF> tif(TIFFOpen(filename.c_str(), "w"), [](TIFF* tif) { TIFFClose(tif); });
+
+    if (tif) {
+        writeDngTags(tif, width, height, compression, dng_metadata, exif_metadata);
+
+        // Lossless JPEG data is written as a row of tiles per band, other compression schemes as one strip per band
+        const uint32_t bandRows = compression == COMPRESSION_JPEG ? dngTileSize(band_size) : band_size;
+        const uint32_t tilesAcross = (width + bandRows - 1) / bandRows;
+
+        if (compression == COMPRESSION_JPEG) {
+            TIFFSetField(tif, TIFFTAG_TILEWIDTH, bandRows);
+            TIFFSetField(tif, TIFFTAG_TILELENGTH, bandRows);
+        } else {
+            TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, bandRows);
+        }
+
+        // Only one band and its encoded tiles are resident at any time
+        std::vector<uint16_t> band(bandRows * width);
+        std::vector<std::vector<uint8_t>> encodedTiles(compression == COMPRESSION_JPEG ? tilesAcross : 0);
 
-        if (exif_metadata) {
-            writeExifMetadata(tif, exif_metadata);
+        size_t writtenBytes = 0;
+        for (uint32_t row = 0, index = 0; row < (uint32_t)height; row += bandRows, index++) {
+            const uint32_t nrow = std::min(row + bandRows, (uint32_t)height) - row;
+
+            if (!produce_band(row, nrow, band.data(), width)) {
+                throw std::runtime_error("DNG band producer failed at row " + std::to_string(row));
+            }
+
+            if (compression == COMPRESSION_JPEG) {
+                parallel_for(tilesAcross, dng_encode_threads(), [&](int tile) {
+                    const uint32_t tileX = bandRows * tile;
+                    const uint32_t tileWidth = std::min(tileX + bandRows, (uint32_t)width) - tileX;
+
+                    encodeDngTile(band.data() + tileX, width, tileWidth, nrow, bandRows, &encodedTiles[tile]);
+                });
+
+                // libtiff is not thread safe, write the tiles in order
+                for (uint32_t tile = 0; tile < tilesAcross; tile++) {
+                    const uint32_t tileIndex = index * tilesAcross + tile;
+                    if (TIFFWriteRawTile(tif, tileIndex, encodedTiles[tile].data(), encodedTiles[tile].size()) < 0) {
+                        throw std::runtime_error("Failed to write TIFF tile " + std::to_string(tileIndex));
+                    }
+                    writtenBytes += encodedTiles[tile].size();
+                }
+            } else {
+                const tsize_t stripBytes = nrow * width * sizeof(uint16_t);
+                if (TIFFWriteEncodedStrip(tif, index, band.data(), stripBytes) < 0) {
+                    throw std::runtime_error("Failed to encode TIFF strip " + std::to_string(index));
+                }
+                writtenBytes += stripBytes;
+            }
         }
+        gls::logging::LogDebug(TAG) << "Streamed " << writtenBytes << " image bytes in bands of " << bandRows
+                                    << " rows." << std::endl;
+
+        finalizeDngFile(tif, exif_metadata);
     } else {
         throw std::runtime_error("Couldn't open DNG file for writing.");
     }
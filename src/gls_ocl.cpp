@@ -5,4 +5,431 @@
 //  Created by Fabio Riccardi on 8/23/23.
 //
 
+#include "gls_ocl.hpp"
+
 #include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace gls
+{
+
+static const char* TAG = "GLS_OCL";
+
+static std::string tuningDeviceKey(const cl::Device& device)
+{
+    std::string key = device.getInfo<CL_DEVICE_NAME>() + " / " + device.getInfo<CL_DRIVER_VERSION>();
+    // The tuning file is tab separated
+    std::replace(key.begin(), key.end(), '\t', ' ');
+    return key;
+}
+
+OCLWorkGroupTuner::OCLWorkGroupTuner(const cl::Device& device, const std::string& tuningFile)
+    : _deviceKey(tuningDeviceKey(device)), _tuningFile(tuningFile)
+{
+    load();
+}
+
+// Tuning file lines: device key, kernel name, grid width, grid height, local width, local height; tab separated
+void OCLWorkGroupTuner::load()
+{
+    if (_tuningFile.empty())
+    {
+        return;
+    }
+    std::ifstream file(_tuningFile);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string deviceKey, kernelName;
+        int gridWidth, gridHeight, localWidth, localHeight;
+        if (!std::getline(fields, deviceKey, '\t') || !std::getline(fields, kernelName, '\t') ||
+            !(fields >> gridWidth >> gridHeight >> localWidth >> localHeight))
+        {
+            continue;
+        }
+        if (deviceKey == _deviceKey)
+        {
+            _entries[{kernelName, gridWidth, gridHeight}].best = gls::size(localWidth, localHeight);
+        }
+        else
+        {
+            _otherDevices.push_back(line);
+        }
+    }
+}
+
+void OCLWorkGroupTuner::save() const
+{
+    if (_tuningFile.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    // Write to a temporary file and rename it, so that readers never see a partial file
+    // Per process temporary file, so that processes sharing the tuning file don't write over each other's
+    const std::string tmpFile = _tuningFile + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream file(tmpFile, std::ios::out | std::ios::trunc);
+        for (const auto& line : _otherDevices)
+        {
+            file << line << "\n";
+        }
+        for (const auto& [key, entry] : _entries)
+        {
+            if (entry.best)
+            {
+                file << _deviceKey << "\t" << std::get<0>(key) << "\t" << std::get<1>(key) << "\t" << std::get<2>(key)
+                     << "\t" << entry.best->width << "\t" << entry.best->height << "\n";
+            }
+        }
+        if (!file)
+        {
+            gls::logging::LogError(TAG) << "Couldn't write work group tuning file " << tmpFile << std::endl;
+            return;
+        }
+    }
+    rename(tmpFile.c_str(), _tuningFile.c_str());
+}
+
+// Static
+std::vector<gls::size> OCLWorkGroupTuner::candidateSizes(const gls::size& gridSize, size_t maxWorkGroupSize)
+{
+    std::vector<gls::size> candidates = {{0, 0}};
+    // Power of 2 work groups of 32 to 256 items dividing the grid, from wide to tall with an aspect ratio of 16:1
+    // to 1:2
+    for (size_t items = 32; items <= std::min<size_t>(maxWorkGroupSize, 256); items *= 2)
+    {
+        for (int width = (int)items; width >= 1; width /= 2)
+        {
+            const int height = (int)items / width;
+            if (gridSize.width % width == 0 && gridSize.height % height == 0 &&
+                (width <= 16 * height || gridSize.height == 1) && height <= 2 * width)
+            {
+                candidates.push_back({width, height});
+            }
+        }
+    }
+    return candidates;
+}
+
+void OCLWorkGroupTuner::collectTimes(Entry* entry)
+{
+    for (auto& candidate : entry->candidates)
+    {
+        for (auto event = candidate.pending.begin(); event != candidate.pending.end();)
+        {
+            if (event->getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE)
+            {
+                event++;
+                continue;
+            }
+            try
+            {
+                const cl_ulong start = event->getProfilingInfo<CL_PROFILING_COMMAND_START>();
+                const cl_ulong end = event->getProfilingInfo<CL_PROFILING_COMMAND_END>();
+                candidate.times.push_back((end - start) / 1000000.0);
+            }
+            catch (const cl::Error& e)
+            {
+                // Queue without profiling, can't tune
+                candidate.times.push_back(-1);
+            }
+            event = candidate.pending.erase(event);
+        }
+    }
+}
+
+gls::size OCLWorkGroupTuner::localSize(const cl::Kernel& kernel, const std::string& kernelName,
+                                       const gls::size& gridSize, int* candidate)
+{
+    *candidate = -1;
+
+    std::unique_lock<std::mutex> guard(_mutex);
+    Entry& entry = _entries[{kernelName, gridSize.width, gridSize.height}];
+    if (entry.best)
+    {
+        return *entry.best;
+    }
+    if (entry.untimedDispatches > 0)
+    {
+        entry.untimedDispatches--;
+        return gls::size(0, 0);
+    }
+
+    if (entry.candidates.empty())
+    {
+        const cl::Device device = cl::Device::getDefault();
+        const size_t maxWorkGroupSize = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+        for (const auto& size : candidateSizes(gridSize, maxWorkGroupSize))
+        {
+            entry.candidates.push_back({.localSize = size, .pending = {}, .times = {}});
+        }
+    }
+
+    collectTimes(&entry);
+
+    // Untimed dispatches leave the choice to the driver for a while. Nothing is recorded, so that a later dispatch
+    // on a profiling queue still tunes the kernel.
+    for (const auto& c : entry.candidates)
+    {
+        if (std::find(c.times.begin(), c.times.end(), -1) != c.times.end())
+        {
+            entry.untimedDispatches = untimedRetryInterval;
+            entry.candidates.clear();
+            return gls::size(0, 0);
+        }
+    }
+
+    // Time the candidate with the fewest samples, including the ones in flight
+    int next = -1;
+    size_t nextSamples = samplesPerCandidate;
+    for (size_t i = 0; i < entry.candidates.size(); i++)
+    {
+        size_t samples = entry.candidates[i].times.size() + entry.candidates[i].pending.size();
+        if (samples < nextSamples)
+        {
+            next = (int)i;
+            nextSamples = samples;
+        }
+    }
+    if (next >= 0)
+    {
+        *candidate = next;
+        return entry.candidates[next].localSize;
+    }
+
+    // All the samples are taken, wait for the ones in flight using the driver's choice
+    bool complete = std::all_of(entry.candidates.begin(), entry.candidates.end(),
+                                [](const Candidate& c) { return c.pending.empty(); });
+    if (!complete)
+    {
+        return gls::size(0, 0);
+    }
+
+    const auto fastest = [](const Candidate& c) { return *std::min_element(c.times.begin(), c.times.end()); };
+    const auto best = std::min_element(entry.candidates.begin(), entry.candidates.end(),
+                                       [&](const Candidate& a, const Candidate& b) { return fastest(a) < fastest(b); });
+    entry.best = best->localSize;
+    entry.candidates.clear();
+
+    gls::logging::LogInfo(TAG) << "Tuned work group size of " << kernelName << " for " << gridSize.width << "x"
+                               << gridSize.height << ": " << entry.best->width << "x" << entry.best->height
+                               << std::endl;
+
+    guard.unlock();
+    save();
+    return *entry.best;
+}
+
+void OCLWorkGroupTuner::record(const std::string& kernelName, const gls::size& gridSize, int candidate,
+                               const cl::Event& event)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    Entry& entry = _entries[{kernelName, gridSize.width, gridSize.height}];
+    if (!entry.best && candidate >= 0 && (size_t)candidate < entry.candidates.size())
+    {
+        entry.candidates[candidate].pending.push_back(event);
+    }
+}
+
+std::optional<gls::size> OCLWorkGroupTuner::tunedSize(const std::string& kernelName, const gls::size& gridSize) const
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    auto entry = _entries.find({kernelName, gridSize.width, gridSize.height});
+    if (entry != _entries.end())
+    {
+        return entry->second.best;
+    }
+    return std::nullopt;
+}
+
+OCLProfiler::OCLProfiler(size_t maxRecords, const std::string& traceFile)
+    : _maxRecords(maxRecords), _traceFile(traceFile)
+{
+}
+
+OCLProfiler::~OCLProfiler()
+{
+    if (!_traceFile.empty())
+    {
+        writeChromeTrace(_traceFile);
+    }
+}
+
+void OCLProfiler::record(const std::string& name, const std::string& category, const cl::NDRange& globalSize,
+                         const cl::Event& event)
+{
+    std::array<size_t, 3> size = {1, 1, 1};
+    for (size_t i = 0; i < globalSize.dimensions(); i++)
+    {
+        size[i] = ((const size_t*)globalSize)[i];
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    _pending.push_back({name, category, size, event});
+    // Keep the pending list short in long running sessions that never look at the results
+    if (_pending.size() >= 1024)
+    {
+        collectLocked();
+    }
+}
+
+void OCLProfiler::collectLocked()
+{
+    auto pending = _pending.begin();
+    for (auto& p : _pending)
+    {
+        if (p.event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() > CL_COMPLETE)
+        {
+            // Still in flight, keep it for later
+            if (&*pending != &p)
+            {
+                *pending = std::move(p);
+            }
+            pending++;
+            continue;
+        }
+
+        try
+        {
+            const cl_command_queue queue = p.event.getInfo<CL_EVENT_COMMAND_QUEUE>()();
+            auto queueIndex = std::find(_queues.begin(), _queues.end(), queue);
+            if (queueIndex == _queues.end())
+            {
+                queueIndex = _queues.insert(_queues.end(), queue);
+            }
+
+            _records.push_back({.name = p.name,
+                                .category = p.category,
+                                .globalSize = p.globalSize,
+                                .queue = (int)(queueIndex - _queues.begin()),
+                                .queued = p.event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(),
+                                .submit = p.event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>(),
+                                .start = p.event.getProfilingInfo<CL_PROFILING_COMMAND_START>(),
+                                .end = p.event.getProfilingInfo<CL_PROFILING_COMMAND_END>()});
+            if (_records.size() > _maxRecords)
+            {
+                _records.pop_front();
+            }
+        }
+        catch (const cl::Error& e)
+        {
+            // Queue without profiling, or the command failed
+            _unprofiled++;
+        }
+    }
+    _pending.erase(pending, _pending.end());
+}
+
+void OCLProfiler::collect()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    collectLocked();
+}
+
+std::vector<OCLProfiler::Record> OCLProfiler::records()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    collectLocked();
+    return std::vector<Record>(_records.begin(), _records.end());
+}
+
+std::map<std::string, OCLProfiler::Statistics> OCLProfiler::statistics()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    collectLocked();
+
+    std::map<std::string, Statistics> statistics;
+    for (const auto& record : _records)
+    {
+        const double ms = (record.end - record.start) / 1000000.0;
+        Statistics& s = statistics[record.name];
+        s.count++;
+        s.totalMs += ms;
+        s.minMs = std::min(s.minMs, ms);
+        s.maxMs = std::max(s.maxMs, ms);
+    }
+    return statistics;
+}
+
+size_t OCLProfiler::unprofiledCount()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    collectLocked();
+    return _unprofiled;
+}
+
+static std::string jsonEscape(const std::string& s)
+{
+    std::string escaped;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += (unsigned char)c < 0x20 ? ' ' : c;
+    }
+    return escaped;
+}
+
+// Chrome Trace Event Format: one complete ("X") event per command on a track per command queue, times in microseconds
+std::string OCLProfiler::chromeTrace()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    collectLocked();
+
+    cl_ulong origin = std::numeric_limits<cl_ulong>::max();
+    for (const auto& record : _records)
+    {
+        origin = std::min(origin, record.queued);
+    }
+
+    std::ostringstream trace;
+    trace << std::fixed << std::setprecision(3);
+    trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < _queues.size(); i++)
+    {
+        trace << (i > 0 ? "," : "") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+              << ",\"args\":{\"name\":\"Command Queue " << i << "\"}}";
+    }
+    for (const auto& record : _records)
+    {
+        trace << ",\n{\"name\":\"" << jsonEscape(record.name) << "\",\"cat\":\"" << jsonEscape(record.category)
+              << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << record.queue
+              << ",\"ts\":" << (record.start - origin) / 1000.0 << ",\"dur\":" << (record.end - record.start) / 1000.0
+              << ",\"args\":{\"global_size\":[" << record.globalSize[0] << "," << record.globalSize[1] << ","
+              << record.globalSize[2] << "],\"queued_us\":" << (record.queued - origin) / 1000.0
+              << ",\"submit_us\":" << (record.submit - origin) / 1000.0 << "}}";
+    }
+    trace << "\n]}\n";
+    return trace.str();
+}
+
+void OCLProfiler::writeChromeTrace(const std::string& path)
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    file << chromeTrace();
+    if (!file)
+    {
+        gls::logging::LogError(TAG) << "Couldn't write Chrome trace " << path << std::endl;
+    }
+}
+
+void OCLProfiler::clear()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    _pending.clear();
+    _records.clear();
+    _queues.clear();
+    _unprofiled = 0;
+}
+
+}  // namespace gls
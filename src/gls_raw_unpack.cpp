@@ -0,0 +1,285 @@
+// Copyright (c) 2021-2023 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gls_raw_unpack.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GLS_RAW_UNPACK_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GLS_RAW_UNPACK_NEON
+#endif
+
+namespace gls {
+
+int raw_packing_bits(raw_packing packing) {
+    switch (packing) {
+        case raw_packing::msb_10:
+        case raw_packing::mipi_raw10:
+            return 10;
+        case raw_packing::msb_12:
+        case raw_packing::mipi_raw12:
+            return 12;
+        case raw_packing::msb_14:
+            return 14;
+    }
+    throw std::runtime_error("Unknown raw packing " + std::to_string((int)packing));
+}
+
+static bool isMipi(raw_packing packing) {
+    return packing == raw_packing::mipi_raw10 || packing == raw_packing::mipi_raw12;
+}
+
+// Samples per MIPI group, the group is followed by a byte holding their low bits
+static int mipiGroupSamples(raw_packing packing) { return packing == raw_packing::mipi_raw10 ? 4 : 2; }
+
+size_t packed_raw_size(raw_packing packing, size_t samples) {
+    if (isMipi(packing)) {
+        const size_t groupSamples = mipiGroupSamples(packing);
+        return (samples + groupSamples - 1) / groupSamples * (groupSamples + 1);
+    }
+    return (samples * raw_packing_bits(packing) + 7) / 8;
+}
+
+static void unpackMsbScalar(int bits, const uint8_t* in, uint16_t* out, size_t samples) {
+    const uint32_t mask = (1 << bits) - 1;
+
+    uint32_t buffer = 0;
+    int available = 0;
+    for (size_t i = 0; i < samples; i++) {
+        while (available < bits) {
+            buffer = (buffer << 8) | *in++;
+            available += 8;
+        }
+        available -= bits;
+        out[i] = (uint16_t)((buffer >> available) & mask);
+    }
+}
+
+static void unpackMipiScalar(raw_packing packing, const uint8_t* in, uint16_t* out, size_t samples) {
+    const int groupSamples = mipiGroupSamples(packing);
+    const int lowBits = raw_packing_bits(packing) - 8;
+    const int lowMask = (1 << lowBits) - 1;
+
+    for (size_t i = 0; i < samples; i += groupSamples, in += groupSamples + 1) {
+        const int low = in[groupSamples];
+        for (int j = 0; j < groupSamples && i + j < samples; j++) {
+            out[i + j] = (uint16_t)((in[j] << lowBits) | ((low >> (j * lowBits)) & lowMask));
+        }
+    }
+}
+
+// The SIMD unpackers process groups of 8 samples, loaded as 16 bytes. Each 16 bit output lane is the OR of two terms
+// of the form ((shuffle(bytes) * mul) & 0xffff) >> shift. The shuffles gather the (up to three) bytes holding a sample
+// into 16 bit words, the multiplications discard the bits of the preceding sample and the shifts align the result.
+// All the formats are expressed this way, only the tables differ.
+struct unpack_kernel {
+    std::array<uint8_t, 16> shuffleA = {};  // Byte indices, 0x80 = zero
+    std::array<uint8_t, 16> shuffleB = {};
+    std::array<uint16_t, 8> mulA = {};
+    std::array<uint16_t, 8> mulB = {};
+    int shiftA = 0;
+    int shiftB = 0;
+    int groupBytes = 0;  // Packed size of 8 samples
+};
+
+constexpr unpack_kernel makeUnpackKernel(raw_packing packing) {
+    unpack_kernel k;
+    const bool mipi = packing == raw_packing::mipi_raw10 || packing == raw_packing::mipi_raw12;
+    const int bits = packing == raw_packing::msb_10 || packing == raw_packing::mipi_raw10 ? 10
+                     : packing == raw_packing::msb_14                                     ? 14
+                                                                                          : 12;
+    k.shuffleA.fill(0x80);
+    k.shuffleB.fill(0x80);
+
+    if (mipi) {
+        // High byte of the sample in A, its low bits extracted from the group's last byte in B
+        const int groupSamples = packing == raw_packing::mipi_raw10 ? 4 : 2;
+        const int lowBits = bits - 8;
+        for (int i = 0; i < 8; i++) {
+            const int base = (i / groupSamples) * (groupSamples + 1);
+            const int j = i % groupSamples;
+            k.shuffleA[2 * i + 1] = base + j;
+            k.mulA[i] = 1;
+            k.shuffleB[2 * i + 1] = base + groupSamples;
+            k.mulB[i] = 1 << (8 - lowBits - j * lowBits);
+        }
+        k.shiftA = 16 - bits;
+        k.shiftB = 16 - lowBits;
+        k.groupBytes = 8 / groupSamples * (groupSamples + 1);
+    } else {
+        // Big endian word of the sample's first two bytes in A, the top bits of a third byte in B
+        for (int i = 0; i < 8; i++) {
+            const int byte = i * bits / 8;
+            const int offset = i * bits % 8;
+            k.shuffleA[2 * i] = byte + 1;
+            k.shuffleA[2 * i + 1] = byte;
+            k.mulA[i] = 1 << offset;
+            const int extraBits = offset + bits - 16;
+            if (extraBits > 0) {
+                k.shuffleB[2 * i] = byte + 2;
+                k.mulB[i] = 1 << extraBits;
+            }
+        }
+        k.shiftA = 16 - bits;
+        k.shiftB = 8;
+        k.groupBytes = bits;
+    }
+    return k;
+}
+
+#if defined(GLS_RAW_UNPACK_X86)
+
+template <raw_packing packing>
+__attribute__((target("ssse3"))) static void unpackSSSE3(const uint8_t* in, uint16_t* out, size_t groups) {
+    static constexpr unpack_kernel k = makeUnpackKernel(packing);
+
+    const __m128i shuffleA = _mm_loadu_si128((const __m128i*)k.shuffleA.data());
+    const __m128i shuffleB = _mm_loadu_si128((const __m128i*)k.shuffleB.data());
+    const __m128i mulA = _mm_loadu_si128((const __m128i*)k.mulA.data());
+    const __m128i mulB = _mm_loadu_si128((const __m128i*)k.mulB.data());
+
+    for (size_t g = 0; g < groups; g++) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(in + g * k.groupBytes));
+        const __m128i a = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(v, shuffleA), mulA), k.shiftA);
+        const __m128i b = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(v, shuffleB), mulB), k.shiftB);
+        _mm_storeu_si128((__m128i*)(out + 8 * g), _mm_or_si128(a, b));
+    }
+}
+
+template <raw_packing packing>
+__attribute__((target("avx2"))) static void unpackAVX2(const uint8_t* in, uint16_t* out, size_t groups) {
+    static constexpr unpack_kernel k = makeUnpackKernel(packing);
+
+    // Two groups per iteration, one in each 128 bit lane
+    const __m256i shuffleA = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)k.shuffleA.data()));
+    const __m256i shuffleB = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)k.shuffleB.data()));
+    const __m256i mulA = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)k.mulA.data()));
+    const __m256i mulB = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)k.mulB.data()));
+
+    size_t g = 0;
+    for (; g + 2 <= groups; g += 2) {
+        const __m128i v0 = _mm_loadu_si128((const __m128i*)(in + g * k.groupBytes));
+        const __m128i v1 = _mm_loadu_si128((const __m128i*)(in + (g + 1) * k.groupBytes));
+        const __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(v0), v1, 1);
+        const __m256i a = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(v, shuffleA), mulA), k.shiftA);
+        const __m256i b = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(v, shuffleB), mulB), k.shiftB);
+        _mm256_storeu_si256((__m256i*)(out + 8 * g), _mm256_or_si256(a, b));
+    }
+    if (g < groups) {
+        unpackSSSE3<packing>(in + g * k.groupBytes, out + 8 * g, groups - g);
+    }
+}
+
+template <raw_packing packing>
+static void unpackSIMD(const uint8_t* in, uint16_t* out, size_t groups) {
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    static const bool hasSSSE3 = __builtin_cpu_supports("ssse3");
+
+    if (hasAVX2) {
+        unpackAVX2<packing>(in, out, groups);
+    } else if (hasSSSE3) {
+        unpackSSSE3<packing>(in, out, groups);
+    } else {
+        throw std::logic_error("SSSE3 not available");
+    }
+}
+
+static bool simdAvailable() {
+    static const bool hasSSSE3 = __builtin_cpu_supports("ssse3");
+    return hasSSSE3;
+}
+
+#elif defined(GLS_RAW_UNPACK_NEON)
+
+template <raw_packing packing>
+static void unpackSIMD(const uint8_t* in, uint16_t* out, size_t groups) {
+    static constexpr unpack_kernel k = makeUnpackKernel(packing);
+
+    // Out of range table indices (0x80) produce zeros, as with pshufb
+    const uint8x16_t shuffleA = vld1q_u8(k.shuffleA.data());
+    const uint8x16_t shuffleB = vld1q_u8(k.shuffleB.data());
+    const uint16x8_t mulA = vld1q_u16(k.mulA.data());
+    const uint16x8_t mulB = vld1q_u16(k.mulB.data());
+
+    for (size_t g = 0; g < groups; g++) {
+        const uint8x16_t v = vld1q_u8(in + g * k.groupBytes);
+        const uint16x8_t a = vshrq_n_u16(vmulq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, shuffleA)), mulA), k.shiftA);
+        const uint16x8_t b = vshrq_n_u16(vmulq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, shuffleB)), mulB), k.shiftB);
+        vst1q_u16(out + 8 * g, vorrq_u16(a, b));
+    }
+}
+
+static bool simdAvailable() { return true; }
+
+#endif
+
+#if defined(GLS_RAW_UNPACK_X86) || defined(GLS_RAW_UNPACK_NEON)
+
+// Unpack the leading groups of 8 samples whose 16 byte loads stay within the packed data, returns the samples done
+static size_t unpackGroupsSIMD(raw_packing packing, const uint8_t* in, uint16_t* out, size_t samples) {
+    const size_t packedSize = packed_raw_size(packing, samples);
+    const size_t groupBytes = makeUnpackKernel(packing).groupBytes;
+    if (packedSize < 16) {
+        return 0;
+    }
+    const size_t groups = std::min(samples / 8, (packedSize - 16) / groupBytes + 1);
+
+    switch (packing) {
+        case raw_packing::msb_10:
+            unpackSIMD<raw_packing::msb_10>(in, out, groups);
+            break;
+        case raw_packing::msb_12:
+            unpackSIMD<raw_packing::msb_12>(in, out, groups);
+            break;
+        case raw_packing::msb_14:
+            unpackSIMD<raw_packing::msb_14>(in, out, groups);
+            break;
+        case raw_packing::mipi_raw10:
+            unpackSIMD<raw_packing::mipi_raw10>(in, out, groups);
+            break;
+        case raw_packing::mipi_raw12:
+            unpackSIMD<raw_packing::mipi_raw12>(in, out, groups);
+            break;
+    }
+    return 8 * groups;
+}
+
+#endif
+
+void unpack_raw(raw_packing packing, const uint8_t* packed, uint16_t* unpacked, size_t samples, bool use_simd) {
+    size_t done = 0;
+#if defined(GLS_RAW_UNPACK_X86) || defined(GLS_RAW_UNPACK_NEON)
+    if (use_simd && simdAvailable()) {
+        done = unpackGroupsSIMD(packing, packed, unpacked, samples);
+    }
+#endif
+
+    // Groups of 8 samples end on a byte (and MIPI group) boundary, the scalar code picks up from there
+    const uint8_t* in = packed + packed_raw_size(packing, done);
+    if (isMipi(packing)) {
+        unpackMipiScalar(packing, in, unpacked + done, samples - done);
+    } else {
+        unpackMsbScalar(raw_packing_bits(packing), in, unpacked + done, samples - done);
+    }
+}
+
+}  // namespace gls
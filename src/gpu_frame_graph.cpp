@@ -0,0 +1,133 @@
+#include "glass_image/gpu_frame_graph.h"
+
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace gls
+{
+
+void GpuFrameGraph::AddPass(const std::string& name, const std::vector<ResourceId>& reads,
+                            const std::vector<ResourceId>& writes, std::function<cl::Event()> execute)
+{
+    if (backing_) throw std::runtime_error("AddPass() called on a GpuFrameGraph that is already compiled.");
+
+    for (const auto& list : {reads, writes})
+        for (ResourceId id : list)
+            if (id >= resources_.size())
+                throw std::runtime_error(std::format("Pass {} uses unknown transient resource {}.", name, id));
+
+    passes_.push_back({.name = name, .reads = reads, .writes = writes, .execute = execute});
+}
+
+void GpuFrameGraph::Compile()
+{
+    if (backing_) return;
+
+    // Lifetimes: from the first pass writing a resource to the last pass using it
+    constexpr size_t unused = std::numeric_limits<size_t>::max();
+    std::vector<TransientRange> ranges(resources_.size(), TransientRange{.first_pass = unused, .last_pass = 0});
+    for (size_t i = 0; i < passes_.size(); i++)
+    {
+        for (ResourceId id : passes_[i].reads)
+        {
+            if (ranges[id].first_pass == unused)
+                throw std::runtime_error(std::format("Pass {} reads transient resource {} before it is written.",
+                                                     passes_[i].name, id));
+            ranges[id].last_pass = i;
+        }
+        for (ResourceId id : passes_[i].writes)
+        {
+            ranges[id].first_pass = std::min(ranges[id].first_pass, i);
+            ranges[id].last_pass = i;
+        }
+    }
+
+    // Only plan the resources which are actually used
+    std::vector<TransientRange> used_ranges;
+    std::vector<ResourceId> used_ids;
+    for (ResourceId id = 0; id < resources_.size(); id++)
+    {
+        if (ranges[id].first_pass != unused)
+        {
+            ranges[id].bytes = resources_[id].bytes;
+            used_ranges.push_back(ranges[id]);
+            used_ids.push_back(id);
+        }
+    }
+
+    // Sub-buffer origins must be aligned to the device base address alignment, which is a multiple of any pixel size
+    cl::Device device = cl::Device::getDefault();
+    const size_t alignment = std::max<size_t>(device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8, 64);
+
+    const size_t total_bytes = std::max(PlanTransientMemory(used_ranges, alignment), alignment);
+    backing_.emplace(gpu_context_, total_bytes);
+
+    for (size_t i = 0; i < used_ids.size(); i++)
+    {
+        Resource& resource = resources_[used_ids[i]];
+        resource.image = resource.create(backing_->buffer(), used_ranges[i].offset);
+    }
+}
+
+cl::Event GpuFrameGraph::Execute()
+{
+    Compile();
+
+    cl::Event event;
+    for (auto& pass : passes_)
+    {
+        event = pass.execute();
+    }
+    return event;
+}
+
+size_t GpuFrameGraph::TransientBytes() const
+{
+    return std::accumulate(resources_.begin(), resources_.end(), (size_t)0,
+                           [](size_t sum, const Resource& resource) { return sum + resource.bytes; });
+}
+
+size_t GpuFrameGraph::PlanTransientMemory(std::vector<TransientRange>& ranges, size_t alignment)
+{
+    const auto align = [alignment](size_t value) { return (value + alignment - 1) / alignment * alignment; };
+
+    std::vector<size_t> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return ranges[a].bytes > ranges[b].bytes; });
+
+    size_t total_bytes = 0;
+    std::vector<size_t> placed;
+    for (size_t index : order)
+    {
+        TransientRange& range = ranges[index];
+
+        // Placed ranges alive at the same time as this one, by offset
+        std::vector<size_t> conflicts;
+        for (size_t other : placed)
+        {
+            if (ranges[other].first_pass <= range.last_pass && range.first_pass <= ranges[other].last_pass)
+                conflicts.push_back(other);
+        }
+        std::sort(conflicts.begin(), conflicts.end(),
+                  [&](size_t a, size_t b) { return ranges[a].offset < ranges[b].offset; });
+
+        // Lowest gap large enough
+        size_t offset = 0;
+        for (size_t other : conflicts)
+        {
+            if (offset + range.bytes <= ranges[other].offset) break;
+            offset = std::max(offset, align(ranges[other].offset + ranges[other].bytes));
+        }
+
+        range.offset = offset;
+        total_bytes = std::max(total_bytes, offset + range.bytes);
+        placed.push_back(index);
+    }
+    return align(total_bytes);
+}
+
+}  // namespace gls
@@ -24,9 +24,10 @@ GpuImage<T>::GpuImage(std::shared_ptr<gls::OCLContext> gpu_context, const size_t
       row_pitch_(gu::GetBestRowPitch<T>(width)),
       is_mapped_(std::make_shared<std::atomic<bool>>(false)),
       flags_(flags),
-      buffer_(GpuBuffer<T>(gpu_context, row_pitch_ * height_, flags))
+      buffer_(GpuBuffer<T>(gpu_context, row_pitch_ * height_,
+                           gu::GetImagePoolKey<T>(row_pitch_, width_, height_, 1, flags)))
 {
-    image_ = CreateImage2dFromBuffer(buffer_.value(), 0, row_pitch_, width_, height_, flags);
+    image_ = CreateImage2d();
 }
 
 template <typename T>
@@ -37,9 +38,10 @@ GpuImage<T>::GpuImage(std::shared_ptr<gls::OCLContext> gpu_context, const gls::i
       row_pitch_(gu::GetBestRowPitch<T>(image.width)),
       is_mapped_(std::make_shared<std::atomic<bool>>(false)),
       flags_(flags),
-      buffer_(GpuBuffer<T>(gpu_context, row_pitch_ * height_, flags))
+      buffer_(GpuBuffer<T>(gpu_context, row_pitch_ * height_,
+                           gu::GetImagePoolKey<T>(row_pitch_, width_, height_, 1, flags)))
 {
-    image_ = CreateImage2dFromBuffer(buffer_.value(), 0, row_pitch_, width_, height_, flags_);
+    image_ = CreateImage2d();
     CopyFrom(image).wait();
 }
 
@@ -112,6 +114,19 @@ GpuImage<T>::GpuImage(std::shared_ptr<gls::OCLContext> gpu_context, cl::Image2D
                                              format.image_channel_data_type));
 }
 
+template <typename T>
+GpuImage<T>::GpuImage(std::shared_ptr<gls::OCLContext> gpu_context, PinnedImage<T>& pinned, cl_mem_flags flags)
+    : gpu_context_(gpu_context),
+      width_(pinned.width),
+      height_(pinned.height),
+      row_pitch_(pinned.stride),
+      is_mapped_(std::make_shared<std::atomic<bool>>(false)),
+      flags_(flags),
+      buffer_(GpuBuffer<T>(gpu_context, pinned.buffer()))
+{
+    image_ = CreateImage2dFromBuffer(buffer_.value(), 0, row_pitch_, width_, height_, flags);
+}
+
 template <typename T>
 gls::image<T> GpuImage<T>::ToImage(std::optional<cl::CommandQueue> queue, const std::vector<cl::Event>& events)
 {
@@ -119,8 +134,10 @@ gls::image<T> GpuImage<T>::ToImage(std::optional<cl::CommandQueue> queue, const
     gls::image<T> host_image(width_, height_);
     const size_t row_pitch = host_image.stride * sizeof(T);
 
+    cl::Event event;
     _queue.enqueueReadImage(image_, CL_TRUE, {0, 0, 0}, {width_, height_, 1}, 0, 0, host_image.pixels().data(),
-                            &events);
+                            &events, &event);
+    gpu_context_->profile("GpuImage::ToImage", "transfer", cl::NDRange(width_, height_), event);
     return host_image;
 }
 
@@ -128,7 +145,7 @@ template <typename T>
 cl::Event GpuImage<T>::CopyFrom(const gls::image<T>& image, std::optional<cl::CommandQueue> queue,
                                 const std::vector<cl::Event>& events)
 {
-    if (image.width != width_ || image.height != height_)
+    if ((size_t)image.width != width_ || (size_t)image.height != height_)
         throw std::runtime_error(std::format("LoadImage() expected image of size {}x{}, got {}x{}.", width_, height_,
                                              image.width, image.height));
 
@@ -138,6 +155,7 @@ cl::Event GpuImage<T>::CopyFrom(const gls::image<T>& image, std::optional<cl::Co
     const size_t row_pitch = image.stride * sizeof(T);
     _queue.enqueueWriteImage(image_, CL_FALSE, {0, 0, 0}, {width_, height_, 1}, row_pitch, 0, image.pixels().data(),
                              &events, &event);  // NOTE: slice_pitch must be 0 for Image2D on Android.
+    gpu_context_->profile("GpuImage::CopyFrom", "transfer", cl::NDRange(width_, height_), event);
     return event;
 }
 
@@ -145,7 +163,7 @@ template <typename T>
 cl::Event GpuImage<T>::CopyTo(gls::image<T>& image, std::optional<cl::CommandQueue> queue,
                               const std::vector<cl::Event>& events)
 {
-    if (image.width != width_ || image.height != height_)
+    if ((size_t)image.width != width_ || (size_t)image.height != height_)
         throw std::runtime_error(std::format("CopyTo() expected image of size {}x{}, got {}x{}.", width_, height_,
                                              image.width, image.height));
 
@@ -154,6 +172,50 @@ cl::Event GpuImage<T>::CopyTo(gls::image<T>& image, std::optional<cl::CommandQue
     const size_t row_pitch = image.stride * sizeof(T);
     _queue.enqueueReadImage(image_, CL_FALSE, {0, 0, 0}, {width_, height_, 1}, row_pitch, 0, image.pixels().data(),
                             &events, &event);  // NOTE: slice_pitch must be 0 for Image2D on Android.
+    gpu_context_->profile("GpuImage::CopyTo", "transfer", cl::NDRange(width_, height_), event);
+    return event;
+}
+
+template <typename T>
+cl::Event GpuImage<T>::CopyFrom(PinnedImage<T>& image, std::optional<cl::CommandQueue> queue,
+                                const std::vector<cl::Event>& events)
+{
+    if (!IsBackedBy(image))
+    {
+        if (!image.is_mapped()) throw std::runtime_error("CopyFrom() expected a mapped PinnedImage.");
+        // Pinned pages are transferred by DMA, with no bounce buffer
+        return CopyFrom(static_cast<const gls::image<T>&>(image), queue, events);
+    }
+
+    // Zero-copy, hand the pixels over to the device
+    cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
+    cl::Event event;
+    if (image.is_mapped())
+        event = image.Unmap(_queue, events);
+    else
+        _queue.enqueueMarkerWithWaitList(&events, &event);
+    gpu_context_->profile("GpuImage::CopyFrom (zero-copy)", "transfer", cl::NDRange(width_, height_), event);
+    return event;
+}
+
+template <typename T>
+cl::Event GpuImage<T>::CopyTo(PinnedImage<T>& image, std::optional<cl::CommandQueue> queue,
+                              const std::vector<cl::Event>& events)
+{
+    if (!IsBackedBy(image))
+    {
+        if (!image.is_mapped()) throw std::runtime_error("CopyTo() expected a mapped PinnedImage.");
+        return CopyTo(static_cast<gls::image<T>&>(image), queue, events);
+    }
+
+    // Zero-copy, hand the pixels back to the host
+    cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
+    cl::Event event;
+    if (!image.is_mapped())
+        event = image.Map(_queue, events);
+    else
+        _queue.enqueueMarkerWithWaitList(&events, &event);
+    gpu_context_->profile("GpuImage::CopyTo (zero-copy)", "transfer", cl::NDRange(width_, height_), event);
     return event;
 }
 
@@ -165,8 +227,10 @@ std::unique_ptr<gls::image<T>, std::function<void(gls::image<T>*)>> GpuImage<T>:
 
     cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
     size_t row_pitch, slice_pitch;
+    cl::Event event;
     void* ptr = _queue.enqueueMapImage(image_, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, {0, 0, 0}, {width_, height_, 1},
-                                       &row_pitch, &slice_pitch, &events);
+                                       &row_pitch, &slice_pitch, &events, &event);
+    gpu_context_->profile("GpuImage::MapImage", "transfer", cl::NDRange(width_, height_), event);
 
     // Create custom deleter that unmaps the image
     auto deleter = [this, ptr, _queue, events](gls::image<T>* img) mutable
@@ -224,9 +288,28 @@ cl::Event GpuImage<T>::Fill(const T& value, std::optional<cl::CommandQueue> queu
     else
         throw std::runtime_error("Unsupported pixel type for GpuImage::Fill()");
 
+    gpu_context_->profile("GpuImage::Fill", "fill", cl::NDRange(width_, height_), event);
     return event;
 }
 
+template <typename T>
+cl::Image2D GpuImage<T>::CreateImage2d()
+{
+    // A recycled block already carries an image of the same shape and format
+    const auto pool_block = buffer_->pool_block();
+    if (pool_block && pool_block->image())
+    {
+        return cl::Image2D(pool_block->image(), /*retainObject=*/true);
+    }
+
+    cl::Image2D image = CreateImage2dFromBuffer(buffer_.value(), 0, row_pitch_, width_, height_, flags_);
+    if (pool_block)
+    {
+        pool_block->image = image;
+    }
+    return image;
+}
+
 template <typename T>
 cl::Image2D GpuImage<T>::CreateImage2dFromBuffer(GpuBuffer<T>& buffer, const size_t offset, const size_t row_pitch,
                                                  const size_t width, const size_t height, cl_mem_flags flags)
@@ -24,9 +24,23 @@ GpuImage3d<T>::GpuImage3d(std::shared_ptr<gls::OCLContext> gpu_context, const si
       row_pitch_(gu::GetBestRowPitch<T>(width)),
       slice_pitch_(height * row_pitch_),
       flags_(flags),
-      buffer_(GpuBuffer<T>(gpu_context, row_pitch_ * height_ * depth_, flags))
+      buffer_(GpuBuffer<T>(gpu_context, row_pitch_ * height_ * depth_,
+                           gu::GetImagePoolKey<T>(row_pitch_, width_, height_, depth_, flags)))
 {
-    image_ = CreateImage3dFromBuffer(buffer_, 0, row_pitch_, slice_pitch_, width_, height_, depth_, flags_);
+    // A recycled block already carries an image of the same shape and format
+    const auto pool_block = buffer_.pool_block();
+    if (pool_block && pool_block->image())
+    {
+        image_ = cl::Image3D(pool_block->image(), /*retainObject=*/true);
+    }
+    else
+    {
+        image_ = CreateImage3dFromBuffer(buffer_, 0, row_pitch_, slice_pitch_, width_, height_, depth_, flags_);
+        if (pool_block)
+        {
+            pool_block->image = image_;
+        }
+    }
 }
 
 template <typename T>
@@ -131,6 +145,7 @@ cl::Event GpuImage3d<T>::Fill(const T& value, std::optional<cl::CommandQueue> qu
     else
         throw std::runtime_error("Unsupported pixel type for GpuImage3d::Fill()");
 
+    gpu_context_->profile("GpuImage3d::Fill", "fill", cl::NDRange(width_, height_, depth_), event);
     return event;
 }
 
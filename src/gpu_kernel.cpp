@@ -18,4 +18,14 @@ GpuKernel::GpuKernel(std::shared_ptr<gls::OCLContext> gpu_context, const std::st
     }
 }
 
+cl::Event GpuKernel::Enqueue(const cl::NDRange& global_size, const cl::NDRange& local_size,
+                             std::optional<cl::CommandQueue> queue, const std::vector<cl::Event>& events)
+{
+    cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
+    cl::Event event;
+    _queue.enqueueNDRangeKernel(kernel_, cl::NullRange, global_size, local_size, &events, &event);
+    gpu_context_->profile(name_, "kernel", global_size, event);
+    return event;
+}
+
 }  // namespace gls
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include "glass_image/gpu_scheduler.h"
+
+#include <format>
+#include <stdexcept>
+
+namespace gls
+{
+
+GpuScheduler::GpuScheduler(std::shared_ptr<gls::OCLContext> gpu_context, size_t queue_count,
+                           cl_command_queue_properties properties)
+    : gpu_context_(gpu_context), in_order_(!(properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE))
+{
+    if (queue_count == 0) throw std::runtime_error("GpuScheduler needs at least one command queue.");
+
+    for (size_t i = 0; i < queue_count; i++)
+        queues_.emplace_back(gpu_context_->clContext(), cl::Device::getDefault(), properties);
+}
+
+GpuScheduler::OperationId GpuScheduler::AddOperation(const std::string& name, Stream stream,
+                                                     const std::vector<GpuAccess>& accesses, Enqueue enqueue)
+{
+    Operation operation{.name = name,
+                        .queue = QueueIndex(stream),
+                        .reads = {},
+                        .writes = {},
+                        .enqueue = enqueue,
+                        .waits = {},
+                        .frame_waits = {},
+                        .is_sink = true,
+                        .event = {}};
+    for (const auto& access : accesses)
+    {
+        if (!access.memory())
+            throw std::runtime_error(std::format("Operation {} accesses a null memory object.", name));
+        (access.write ? operation.writes : operation.reads).push_back(ResolveMemory(access.memory));
+    }
+
+    operations_.push_back(std::move(operation));
+    planned_ = false;
+    return operations_.size() - 1;
+}
+
+GpuScheduler::OperationId GpuScheduler::HostOperation(const std::string& name, const std::vector<GpuAccess>& accesses,
+                                                      std::function<void()> work)
+{
+    return AddOperation(name, Stream::kHost, accesses,
+                        [context = gpu_context_->clContext(), work](const cl::CommandQueue&,
+                                                                    const std::vector<cl::Event>& events)
+                        {
+                            if (!events.empty()) cl::Event::waitForEvents(events);
+                            work();
+                            cl::UserEvent event(context);
+                            event.setStatus(CL_COMPLETE);
+                            return cl::Event(event);
+                        });
+}
+
+bool GpuScheduler::Conflicts(const Operation& a, const Operation& b)
+{
+    const auto overlap = [](const std::vector<MemoryRange>& x, const std::vector<MemoryRange>& y)
+    {
+        for (const auto& rx : x)
+            for (const auto& ry : y)
+                if (rx.Overlaps(ry)) return true;
+        return false;
+    };
+    return overlap(a.writes, b.writes) || overlap(a.writes, b.reads) || overlap(a.reads, b.writes);
+}
+
+void GpuScheduler::Plan()
+{
+    if (planned_) return;
+
+    const size_t count = operations_.size();
+    // ancestors[i][j]: operation j completes before operation i starts, within a frame
+    std::vector<std::vector<bool>> ancestors(count, std::vector<bool>(count, false));
+    const auto inherit = [&](size_t i, size_t j)
+    {
+        ancestors[i][j] = true;
+        for (size_t k = 0; k < j; k++)
+            if (ancestors[j][k]) ancestors[i][k] = true;
+    };
+
+    for (auto& operation : operations_) operation.is_sink = true;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Operation& operation = operations_[i];
+        const bool queued_in_order = in_order_ && operation.queue != kHostQueue;
+
+        // An in-order queue orders the operation after everything issued on it before
+        if (queued_in_order)
+        {
+            for (size_t j = i; j-- > 0;)
+            {
+                if (operations_[j].queue == operation.queue)
+                {
+                    inherit(i, j);
+                    operations_[j].is_sink = false;
+                    break;
+                }
+            }
+        }
+
+        std::vector<OperationId> dependencies;
+        for (size_t j = 0; j < i; j++)
+        {
+            if (Conflicts(operation, operations_[j]))
+            {
+                dependencies.push_back(j);
+                operations_[j].is_sink = false;
+            }
+        }
+
+        // Dependencies which are not already implied by the queue or by another dependency
+        std::vector<bool> implied = ancestors[i];
+        for (OperationId j : dependencies)
+            for (size_t k = 0; k < j; k++)
+                if (ancestors[j][k]) implied[k] = true;
+
+        operation.waits.clear();
+        for (OperationId j : dependencies)
+        {
+            if (!implied[j]) operation.waits.push_back(j);
+            inherit(i, j);
+        }
+
+        // The previous frame's instances of this and later operations are still in flight
+        operation.frame_waits.clear();
+        for (size_t j = i; j < count; j++)
+        {
+            const bool same_queue = queued_in_order && operations_[j].queue == operation.queue;
+            if (!same_queue && Conflicts(operation, operations_[j])) operation.frame_waits.push_back(j);
+        }
+    }
+
+    // Waiting on the last operation of a chain is enough
+    for (auto& operation : operations_)
+    {
+        std::vector<OperationId> frame_waits;
+        for (OperationId j : operation.frame_waits)
+        {
+            bool covered = false;
+            for (OperationId k : operation.frame_waits)
+                if (k > j && ancestors[k][j]) covered = true;
+            if (!covered) frame_waits.push_back(j);
+        }
+        operation.frame_waits = frame_waits;
+    }
+
+    planned_ = true;
+}
+
+std::vector<cl::Event> GpuScheduler::Execute()
+{
+    Plan();
+
+    // Commands have to be flushed before a different queue, or the host, waits on their events
+    std::vector<bool> unflushed(queues_.size(), false);
+    const auto flush_for = [&](const Operation& waiter, const Operation& waited)
+    {
+        if (waited.queue != kHostQueue && waited.queue != waiter.queue && unflushed[waited.queue])
+        {
+            queues_[waited.queue].flush();
+            unflushed[waited.queue] = false;
+        }
+    };
+
+    for (auto& operation : operations_)
+    {
+        std::vector<cl::Event> wait_events;
+        for (OperationId j : operation.frame_waits)
+        {
+            // Not executed yet in the first frame
+            if (operations_[j].event())
+            {
+                wait_events.push_back(operations_[j].event);
+                flush_for(operation, operations_[j]);
+            }
+        }
+        for (OperationId j : operation.waits)
+        {
+            wait_events.push_back(operations_[j].event);
+            flush_for(operation, operations_[j]);
+        }
+
+        static const cl::CommandQueue no_queue;
+        const cl::CommandQueue& queue = operation.queue == kHostQueue ? no_queue : queues_[operation.queue];
+        operation.event = operation.enqueue(queue, wait_events);
+        if (operation.queue != kHostQueue) unflushed[operation.queue] = true;
+    }
+
+    for (size_t q = 0; q < queues_.size(); q++)
+        if (unflushed[q]) queues_[q].flush();
+
+    std::vector<cl::Event> events;
+    for (const auto& operation : operations_)
+        if (operation.is_sink) events.push_back(operation.event);
+    return events;
+}
+
+void GpuScheduler::Finish()
+{
+    for (auto& queue : queues_) queue.finish();
+}
+
+const std::vector<GpuScheduler::OperationId>& GpuScheduler::Dependencies(OperationId operation)
+{
+    Plan();
+    return operations_[operation].waits;
+}
+
+GpuScheduler::MemoryRange GpuScheduler::ResolveMemory(const cl::Memory& memory)
+{
+    MemoryRange range{.root = memory(), .offset = 0, .size = memory.getInfo<CL_MEM_SIZE>()};
+
+    // Images created from a buffer and sub-buffers refer to their parent's storage
+    cl::Memory current = memory;
+    for (cl::Memory parent = current.getInfo<CL_MEM_ASSOCIATED_MEMOBJECT>(); parent();
+         parent = current.getInfo<CL_MEM_ASSOCIATED_MEMOBJECT>())
+    {
+        range.offset += current.getInfo<CL_MEM_OFFSET>();
+        current = parent;
+    }
+    range.root = current();
+    return range;
+}
+
+}  // namespace gls
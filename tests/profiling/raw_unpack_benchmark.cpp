@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gls_raw_unpack.hpp"
+
+using namespace std;
+
+// Unpacks a 24 MP frame repeatedly and reports the best time of each implementation
+double BenchmarkUnpack(gls::raw_packing packing, const std::vector<uint8_t>& packed, std::vector<uint16_t>* unpacked,
+                       bool use_simd, int iterations = 20)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < iterations; i++)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        gls::unpack_raw(packing, packed.data(), unpacked->data(), unpacked->size(), use_simd);
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main()
+{
+    const size_t samples = 6000 * 4000;
+
+    const std::pair<gls::raw_packing, std::string> packings[] = {
+        {gls::raw_packing::msb_10, "msb_10"},         {gls::raw_packing::msb_12, "msb_12"},
+        {gls::raw_packing::msb_14, "msb_14"},         {gls::raw_packing::mipi_raw10, "mipi_raw10"},
+        {gls::raw_packing::mipi_raw12, "mipi_raw12"},
+    };
+
+    std::mt19937 generator(42);
+    std::vector<uint16_t> scalar(samples), simd(samples);
+
+    for (const auto& [packing, name] : packings)
+    {
+        std::vector<uint8_t> packed(gls::packed_raw_size(packing, samples));
+        for (auto& byte : packed)
+        {
+            byte = (uint8_t)generator();
+        }
+
+        double scalar_ms = BenchmarkUnpack(packing, packed, &scalar, /*use_simd=*/false);
+        double simd_ms = BenchmarkUnpack(packing, packed, &simd, /*use_simd=*/true);
+
+        cout << std::fixed << std::setprecision(2) << std::setw(12) << name << ": scalar " << scalar_ms << " ms ("
+             << packed.size() / (scalar_ms * 1e6) << " GB/s), simd " << simd_ms << " ms ("
+             << packed.size() / (simd_ms * 1e6) << " GB/s), " << scalar_ms / simd_ms << "x"
+             << (scalar == simd ? "" : " MISMATCH") << endl;
+    }
+    return 0;
+}
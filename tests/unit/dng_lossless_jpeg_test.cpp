@@ -0,0 +1,320 @@
+#include "gls_dng_lossless_jpeg.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using std::vector;
+
+namespace
+{
+
+vector<uint16_t> MakeTestImage(int width, int height, int channels, int bit_depth)
+{
+    std::mt19937 generator(42);
+    vector<uint16_t> image(width * height * channels);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width * channels; x++)
+        {
+            image[y * width * channels + x] = (uint16_t)((37 * x + 11 * y + generator() % 64) % (1 << bit_depth));
+        }
+    }
+    return image;
+}
+
+vector<uint8_t> Encode(const vector<uint16_t>& image, int width, int height, int channels, int bit_depth,
+                       int restart_rows)
+{
+    vector<uint8_t> encoded(image.size() * sizeof(uint16_t) * 2 + 1024);
+    gls::dng_stream stream(encoded.data(), encoded.size());
+    gls::EncodeLosslessJPEG(image.data(), height, width, channels, bit_depth, width * channels, channels, stream,
+                            restart_rows);
+    encoded.resize(stream.Position());
+    return encoded;
+}
+
+vector<uint16_t> Decode(vector<uint8_t>& encoded, size_t decoded_size, int threads, bool use_lookup_tables = true)
+{
+    gls::dng_stream stream(encoded.data(), encoded.size());
+    gls::dng_spooler spooler;
+    gls::DecodeLosslessJPEG(stream, spooler, decoded_size * sizeof(uint16_t), decoded_size * sizeof(uint16_t),
+                            false, encoded.size(), threads, use_lookup_tables);
+    vector<uint16_t> decoded(spooler.size() / sizeof(uint16_t));
+    std::memcpy(decoded.data(), spooler.data(), spooler.size());
+    return decoded;
+}
+
+}  // namespace
+
+TEST(DngLosslessJpegTest, RoundTrip)
+{
+    for (int channels : {1, 2, 3})
+    {
+        const auto image = MakeTestImage(257, 101, channels, 14);
+        auto encoded = Encode(image, 257, 101, channels, 14, /*restart_rows=*/0);
+        EXPECT_EQ(Decode(encoded, image.size(), /*threads=*/1), image);
+    }
+}
+
+TEST(DngLosslessJpegTest, LookupTablesMatchReferenceDecoder)
+{
+    // From smooth to pure noise data, exercising both short codes and codes longer than the lookup window
+    for (int bit_depth : {8, 12, 16})
+    {
+        for (int noise_bits : {1, 6, 12, 16})
+        {
+            std::mt19937 generator(noise_bits);
+            vector<uint16_t> image(173 * 67);
+            for (size_t i = 0; i < image.size(); i++)
+            {
+                image[i] = (uint16_t)((3 * i + (generator() & ((1 << noise_bits) - 1))) & ((1 << bit_depth) - 1));
+            }
+            auto encoded = Encode(image, 173, 67, 1, bit_depth, /*restart_rows=*/0);
+            const auto reference = Decode(encoded, image.size(), /*threads=*/1, /*use_lookup_tables=*/false);
+            EXPECT_EQ(reference, image);
+            EXPECT_EQ(Decode(encoded, image.size(), /*threads=*/1, /*use_lookup_tables=*/true), reference);
+        }
+    }
+}
+
+TEST(DngLosslessJpegTest, RestartIntervalsParallelDecode)
+{
+    for (int channels : {1, 2, 3})
+    {
+        for (int restart_rows : {1, 3, 16})
+        {
+            const auto image = MakeTestImage(257, 101, channels, 14);
+            auto encoded = Encode(image, 257, 101, channels, 14, restart_rows);
+            EXPECT_EQ(Decode(encoded, image.size(), /*threads=*/1), image);
+            EXPECT_EQ(Decode(encoded, image.size(), /*threads=*/4), image);
+        }
+    }
+}
+
+TEST(DngLosslessJpegTest, DecodeIntoImage)
+{
+    const auto image = MakeTestImage(257, 101, 1, 12);
+    auto encoded = Encode(image, 257, 101, 1, 12, /*restart_rows=*/8);
+
+    for (int threads : {1, 4})
+    {
+        // Padded destination rows
+        gls::image<gls::luma_pixel_16> destination(257, 101, 300);
+        gls::dng_stream stream(encoded.data(), encoded.size());
+        gls::DecodeLosslessJPEG(stream, &destination, false, encoded.size(), threads);
+
+        for (int y = 0; y < destination.height; y++)
+        {
+            for (int x = 0; x < destination.width; x++)
+            {
+                ASSERT_EQ(destination[y][x].luma, image[y * 257 + x]);
+            }
+        }
+    }
+}
+
+TEST(DngLosslessJpegTest, DecodeIntoWindow)
+{
+    // Two channel JPEG rows holding 2 * 64 samples, reinterpreted as rows of 32 samples
+    const auto image = MakeTestImage(64, 40, 2, 14);
+    auto encoded = Encode(image, 64, 40, 2, 14, /*restart_rows=*/5);
+
+    const int row_samples = 32;
+    const int rows = (int)image.size() / row_samples;
+    const int offset_x = 7, width = 20;
+
+    // Windows reaching past the end of the data, and windows skipping whole restart intervals at both ends
+    for (auto [offset_y, height] : {std::pair(11, 100), std::pair(60, 30)})
+    {
+        for (int threads : {1, 4})
+        {
+            vector<uint16_t> destination(width * height, 0);
+            gls::dng_stream stream(encoded.data(), encoded.size());
+            gls::DecodeLosslessJPEG(stream,
+                                    {.data = destination.data(),
+                                     .rowStep = width,
+                                     .width = width,
+                                     .height = (uint32_t)height,
+                                     .rowSamples = row_samples,
+                                     .offsetX = offset_x,
+                                     .offsetY = offset_y},
+                                    false, encoded.size(), threads);
+
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    int source_y = y + offset_y;
+                    int source_x = x + offset_x;
+                    uint16_t expected = source_y < rows && source_x < row_samples
+                                            ? image[source_y * row_samples + source_x]
+                                            : 0;
+                    ASSERT_EQ(destination[y * width + x], expected);
+                }
+            }
+        }
+    }
+}
+
+TEST(DngLosslessJpegTest, TiledDngRoundTrip)
+{
+    gls::image<gls::luma_pixel_16> image(301, 203);
+    const auto data = MakeTestImage(301, 203, 1, 14);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            image[y][x] = data[y * 301 + x];
+        }
+    }
+
+    const std::string filename = testing::TempDir() + "tiled_round_trip.dng";
+    for (int tile_size : {0, 64, 100})
+    {
+        image.write_dng_file(filename, gls::JPEG, nullptr, nullptr, tile_size);
+
+        const auto result = gls::image<gls::luma_pixel_16>::read_dng_file(filename);
+        ASSERT_EQ(result->width, image.width);
+        ASSERT_EQ(result->height, image.height);
+        for (int y = 0; y < image.height; y++)
+        {
+            for (int x = 0; x < image.width; x++)
+            {
+                ASSERT_EQ((*result)[y][x].luma, image[y][x].luma);
+            }
+        }
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(DngLosslessJpegTest, StreamingDngRoundTrip)
+{
+    const int width = 301;
+    const int height = 203;
+    const auto data = MakeTestImage(width, height, 1, 14);
+
+    const std::string filename = testing::TempDir() + "streaming_round_trip.dng";
+    for (auto compression : {gls::JPEG, gls::NONE})
+    {
+        int next_row = 0;
+        gls::write_dng_file_streaming(
+            filename, width, height, compression, nullptr, nullptr,
+            [&](int row, int rows, uint16_t* band, size_t row_step) -> bool
+            {
+                // Bands are requested in order
+                EXPECT_EQ(row, next_row);
+                next_row = row + rows;
+                for (int y = 0; y < rows; y++)
+                {
+                    std::copy(&data[(row + y) * width], &data[(row + y + 1) * width], band + y * row_step);
+                }
+                return true;
+            },
+            /*band_size=*/64);
+        EXPECT_EQ(next_row, height);
+
+        const auto result = gls::image<gls::luma_pixel_16>::read_dng_file(filename);
+        ASSERT_EQ(result->width, width);
+        ASSERT_EQ(result->height, height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                ASSERT_EQ((*result)[y][x].luma, data[y * width + x]);
+            }
+        }
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(DngLosslessJpegTest, RegionOfInterest)
+{
+    gls::image<gls::luma_pixel_16> image(301, 203);
+    const auto data = MakeTestImage(301, 203, 1, 14);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            image[y][x] = data[y * 301 + x];
+        }
+    }
+
+    const gls::rectangle roi(70, 90, 100, 50);
+    auto check_roi = [&](const gls::image<gls::luma_pixel_16>& result)
+    {
+        ASSERT_EQ(result.width, roi.width);
+        ASSERT_EQ(result.height, roi.height);
+        for (int y = 0; y < roi.height; y++)
+        {
+            for (int x = 0; x < roi.width; x++)
+            {
+                ASSERT_EQ(result[y][x].luma, image[roi.y + y][roi.x + x].luma);
+            }
+        }
+    };
+
+    const std::string filename = testing::TempDir() + "region_of_interest.dng";
+    for (auto [compression, tile_size] : {std::pair(gls::JPEG, 0), std::pair(gls::JPEG, 64), std::pair(gls::NONE, 0)})
+    {
+        image.write_dng_file(filename, compression, nullptr, nullptr, tile_size);
+        check_roi(*gls::image<gls::luma_pixel_16>::read_dng_file(filename, nullptr, nullptr, &roi));
+    }
+    std::remove(filename.c_str());
+
+    const std::string tiff_filename = testing::TempDir() + "region_of_interest.tiff";
+    image.write_tiff_file(tiff_filename);
+    check_roi(*gls::image<gls::luma_pixel_16>::read_tiff_file(tiff_filename, nullptr, &roi));
+    std::remove(tiff_filename.c_str());
+}
+
+TEST(DngLosslessJpegTest, TiffStripConversions)
+{
+    gls::image<gls::rgba_pixel_16> image(67, 45);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                image[y][x][c] = (uint16_t)(257 * ((x * 7 + y * 3 + c * 50) % 256));
+            }
+        }
+    }
+
+    const std::string filename = testing::TempDir() + "strip_conversions.tiff";
+    image.write_tiff_file(filename);
+
+    // 16 bits to 8 bits, dropping the alpha channel
+    const auto rgb = gls::image<gls::rgb_pixel>::read_tiff_file(filename);
+    // Same bit depth, fewer channels
+    const auto luma = gls::image<gls::luma_pixel_16>::read_tiff_file(filename);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                ASSERT_EQ((*rgb)[y][x][c], image[y][x][c] >> 8);
+            }
+            ASSERT_EQ((*luma)[y][x].luma, image[y][x].red);
+        }
+    }
+
+    // 8 bits to 16 bits
+    rgb->write_tiff_file(filename);
+    const auto rgb_16 = gls::image<gls::rgb_pixel_16>::read_tiff_file(filename);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                ASSERT_EQ((*rgb_16)[y][x][c], (uint16_t)((*rgb)[y][x][c] << 8));
+            }
+        }
+    }
+    std::remove(filename.c_str());
+}
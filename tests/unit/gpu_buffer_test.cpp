@@ -32,10 +32,7 @@ class CustomBufferAddKernel : gls::GpuKernel
                          const std::vector<cl::Event>& events = {})
     {
         SetArgs(buffer.buffer());
-        cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
-        cl::Event event;
-        _queue.enqueueNDRangeKernel(kernel_, {}, {buffer.size_, 1, 1}, {}, &events, &event);
-        return event;
+        return Enqueue({buffer.size_, 1, 1}, cl::NullRange, queue, events);
     }
 };
 
@@ -0,0 +1,106 @@
+#include "glass_image/gpu_frame_graph.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "glass_image/gpu_image.h"
+#include "glass_image/gpu_kernel.h"
+#include "testing_kernels.h"
+
+using std::vector;
+using TransientRange = gls::GpuFrameGraph::TransientRange;
+
+class ImageAddToKernel : gls::GpuKernel
+{
+   public:
+    ImageAddToKernel(std::shared_ptr<gls::OCLContext> gpu_context) : gls::GpuKernel(gpu_context, "ImageAddKernel") {}
+
+    cl::Event operator()(const gls::GpuImage<float>& input, float value, const gls::GpuImage<float>& output)
+    {
+        SetArgs(input, value, output);
+        return Enqueue({output.width_, output.height_, 1});
+    }
+};
+
+TEST(GpuFrameGraphTest, PlanTransientMemory)
+{
+    // A chain of 4 passes over equally sized images: a -> b -> c -> d, each image only lives for two passes
+    vector<TransientRange> chain = {{.bytes = 1000, .first_pass = 0, .last_pass = 1},
+                                    {.bytes = 1000, .first_pass = 1, .last_pass = 2},
+                                    {.bytes = 1000, .first_pass = 2, .last_pass = 3},
+                                    {.bytes = 1000, .first_pass = 3, .last_pass = 3}};
+    EXPECT_EQ(gls::GpuFrameGraph::PlanTransientMemory(chain, 256), 2048);
+    EXPECT_EQ(chain[0].offset, chain[2].offset);
+    EXPECT_EQ(chain[1].offset, chain[3].offset);
+    EXPECT_NE(chain[0].offset, chain[1].offset);
+
+    // Later images reuse the memory of a large image which is dead after the first pass
+    vector<TransientRange> mixed = {{.bytes = 512, .first_pass = 0, .last_pass = 3},
+                                    {.bytes = 4096, .first_pass = 0, .last_pass = 0},
+                                    {.bytes = 1024, .first_pass = 1, .last_pass = 2},
+                                    {.bytes = 2048, .first_pass = 2, .last_pass = 3}};
+    EXPECT_EQ(gls::GpuFrameGraph::PlanTransientMemory(mixed, 256), 4608);
+
+    // Ranges alive at the same time never overlap in memory
+    for (const auto& a : mixed)
+    {
+        for (const auto& b : mixed)
+        {
+            if (&a != &b && a.first_pass <= b.last_pass && b.first_pass <= a.last_pass)
+            {
+                EXPECT_TRUE(a.offset + a.bytes <= b.offset || b.offset + b.bytes <= a.offset);
+            }
+        }
+    }
+}
+
+TEST(GpuFrameGraphTest, AliasedChain)
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+
+    const size_t width = 256, height = 16;
+    gls::image<float> input_image(width, height);
+    for (int y = 0; y < input_image.height; y++)
+        for (int x = 0; x < input_image.width; x++) input_image[y][x] = y * x;
+
+    gls::GpuImage<float> input(gpu_context, input_image);
+    gls::GpuImage<float> output(gpu_context, width, height);
+    ImageAddToKernel add(gpu_context);
+
+    // input -> t[0] -> t[1] -> ... -> t[5] -> output, adding 1 at every step
+    gls::GpuFrameGraph graph(gpu_context);
+    vector<gls::GpuTransientImage<float>> transients;
+    for (int i = 0; i < 6; i++) transients.push_back(graph.CreateImage<float>(width, height));
+
+    graph.AddPass("first", {}, {transients[0].id}, [&] { return add(input, 1, graph.Image(transients[0])); });
+    for (size_t i = 1; i < transients.size(); i++)
+    {
+        graph.AddPass("step", {transients[i - 1].id}, {transients[i].id},
+                      [&, i] { return add(graph.Image(transients[i - 1]), 1, graph.Image(transients[i])); });
+    }
+    graph.AddPass("last", {transients.back().id}, {}, [&] { return add(graph.Image(transients.back()), 1, output); });
+
+    graph.Compile();
+    EXPECT_LE(graph.AllocatedBytes(), graph.TransientBytes() / 2);
+
+    // Run twice, the second frame reuses the same memory
+    for (int frame = 0; frame < 2; frame++)
+    {
+        graph.Execute().wait();
+        output.ToImage().apply([&](float* pixel, int x, int y) { EXPECT_EQ(*pixel, input_image[y][x] + 7); });
+    }
+}
+
+TEST(GpuFrameGraphTest, ReadBeforeWrite)
+{
+    auto gpu_context = std::make_shared<gls::OCLContext>(std::vector<std::string>{}, "");
+
+    gls::GpuFrameGraph graph(gpu_context);
+    auto image = graph.CreateImage<float>(16, 4);
+    graph.AddPass("read", {image.id}, {}, [] { return cl::Event(); });
+    EXPECT_THROW(graph.Compile(), std::runtime_error);
+}
@@ -0,0 +1,89 @@
+#include "glass_image/gpu_frame_pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "glass_image/gpu_image.h"
+#include "testing_kernels.h"
+
+using std::vector;
+
+TEST(GpuFramePipelineTest, StreamFrames)
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+
+    const gls::size size(256, 64);
+    gls::GpuFramePipeline<float, float> pipeline(
+        gpu_context, size, size,
+        [&](const gls::GpuImage<float>& input, gls::GpuImage<float>& output, const cl::CommandQueue& queue,
+            const std::vector<cl::Event>& events)
+        { return gpu_context->dispatch(queue, "ImageAddKernel", size, {0, 0}, events, input.image(), 1.0f,
+                                       output.image()); });
+
+    // More frames than slots, the input image is reused for every frame
+    const int frame_count = 10;
+    gls::image<float> frame(size.width, size.height);
+    vector<std::future<gls::image<float>::unique_ptr>> results;
+    for (int n = 0; n < frame_count; n++)
+    {
+        for (int y = 0; y < frame.height; y++)
+            for (int x = 0; x < frame.width; x++) frame[y][x] = n * 1000 + y * frame.width + x;
+        results.push_back(pipeline.Submit(frame));
+    }
+
+    for (int n = 0; n < frame_count; n++)
+    {
+        auto result = results[n].get();
+        ASSERT_EQ(result->width, size.width);
+        for (int y = 0; y < result->height; y++)
+            for (int x = 0; x < result->width; x++) ASSERT_EQ((*result)[y][x], n * 1000 + y * frame.width + x + 1);
+    }
+    pipeline.Finish();
+}
+
+TEST(GpuFramePipelineTest, WrongFrameSize)
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+
+    gls::GpuFramePipeline<float, float> pipeline(
+        gpu_context, gls::size(64, 64), gls::size(64, 64),
+        [](const gls::GpuImage<float>&, gls::GpuImage<float>&, const cl::CommandQueue&,
+           const std::vector<cl::Event>&) { return cl::Event(); });
+    EXPECT_THROW(pipeline.Submit(gls::image<float>(32, 32)), std::runtime_error);
+}
+
+TEST(GpuFramePipelineTest, ComputeErrorReleasesSlot)
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+
+    const gls::size size(64, 64);
+    bool fail = true;
+    gls::GpuFramePipeline<float, float> pipeline(
+        gpu_context, size, size,
+        [&](const gls::GpuImage<float>& input, gls::GpuImage<float>& output, const cl::CommandQueue& queue,
+            const std::vector<cl::Event>& events)
+        {
+            if (fail) throw std::runtime_error("Compute failed");
+            return gpu_context->dispatch(queue, "ImageAddKernel", size, {0, 0}, events, input.image(), 1.0f,
+                                         output.image());
+        },
+        1);
+
+    // With a single slot, a slot left busy by the failed frame would block the next Submit() forever
+    gls::image<float> frame(size.width, size.height);
+    frame.apply([](float* pixel, int, int) { *pixel = 1; });
+    EXPECT_THROW(pipeline.Submit(frame), std::runtime_error);
+
+    fail = false;
+    auto result = pipeline.Submit(frame).get();
+    EXPECT_EQ((*result)[10][10], 2);
+}
@@ -197,4 +197,78 @@ TEST(GpuImageTest, WrapClImage)
     gls::image<float> cpu_image = gpu_image.ToImage();
 
     cpu_image.apply([&](float* pixel, int x, int y) { EXPECT_EQ(*pixel, y * w + x); });
-}
\ No newline at end of file
+}
+
+TEST(GpuImageTest, MemoryPool)
+{
+    auto gpu_context = std::make_shared<gls::OCLContext>(std::vector<std::string>{}, "");
+    gpu_context->enableMemoryPool();
+    auto pool = gpu_context->memoryPool();
+
+    const size_t w = 256, h = 4;
+    cl_mem first_image;
+    {
+        gls::GpuImage<float> gpu_image(gpu_context, w, h);
+        first_image = gpu_image.image()();
+        EXPECT_EQ(pool->statistics().hits, 0);
+        EXPECT_EQ(pool->statistics().bytesHeld, 0);
+    }
+    EXPECT_GT(pool->statistics().bytesHeld, 0);
+
+    // Same shape and format: both the buffer and the image are recycled
+    {
+        gls::GpuImage<float> gpu_image(gpu_context, w, h);
+        EXPECT_EQ(gpu_image.image()(), first_image);
+        EXPECT_EQ(pool->statistics().hits, 1);
+        EXPECT_EQ(pool->statistics().bytesHeld, 0);
+
+        gpu_image.Fill(2.5f).wait();
+        gpu_image.ToImage().apply([&](float* pixel, int x, int y) { EXPECT_EQ(*pixel, 2.5f); });
+
+        // A different shape allocates new memory while the first block is in use
+        gls::GpuImage<float> other_image(gpu_context, w, 2 * h);
+        EXPECT_NE(other_image.image()(), first_image);
+    }
+    EXPECT_EQ(pool->statistics().requests, 3);
+    EXPECT_EQ(pool->statistics().bytesInUse, 0);
+    EXPECT_EQ(pool->statistics().peakBytes, pool->statistics().bytesHeld);
+
+    pool->clear();
+    EXPECT_EQ(pool->statistics().bytesHeld, 0);
+}
+
+TEST(GpuImageTest, PinnedImage)
+{
+    auto gpu_context = std::make_shared<gls::OCLContext>(std::vector<std::string>{}, "");
+
+    const size_t w = 64, h = 8;
+    gls::PinnedImage<float> pinned(gpu_context, w, h);
+    EXPECT_TRUE(pinned.is_mapped());
+    EXPECT_GE(pinned.stride, w);
+    for (int y = 0; y < pinned.height; y++)
+        for (int x = 0; x < pinned.width; x++) pinned[y][x] = y * w + x;
+
+    // Copies from and to pinned memory
+    gls::GpuImage<float> gpu_image(gpu_context, w, h);
+    gpu_image.CopyFrom(pinned).wait();
+    gpu_image.ToImage().apply([&](float* pixel, int x, int y) { EXPECT_EQ(*pixel, y * w + x); });
+
+    gpu_image.Fill(1.5f).wait();
+    gpu_image.CopyTo(pinned).wait();
+    pinned.apply([&](float* pixel, int, int) { EXPECT_EQ(*pixel, 1.5f); });
+
+    // Zero-copy: the image lives in the pinned buffer, transfers only unmap and map it
+    gls::GpuImage<float> zero_copy(gpu_context, pinned);
+    EXPECT_TRUE(zero_copy.IsBackedBy(pinned));
+    EXPECT_FALSE(gpu_image.IsBackedBy(pinned));
+
+    zero_copy.CopyFrom(pinned).wait();
+    EXPECT_FALSE(pinned.is_mapped());
+    zero_copy.Fill(2.5f).wait();
+    zero_copy.CopyTo(pinned).wait();
+    EXPECT_TRUE(pinned.is_mapped());
+    // The buffer may be mapped at a new address, the image follows it
+    EXPECT_EQ(pinned.size(), gls::size(w, h));
+    EXPECT_EQ(pinned.pixels().size(), pinned.stride * h);
+    pinned.apply([&](float* pixel, int, int) { EXPECT_EQ(*pixel, 2.5f); });
+}
@@ -3,8 +3,10 @@
 
 #include <gtest/gtest.h>
 
+#include <filesystem>
 #include <numeric>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "glass_image/gpu_buffer.h"
@@ -23,10 +25,7 @@ class BufferAddKernel : gls::GpuKernel
                          const std::vector<cl::Event>& events = {})
     {
         SetArgs(buffer, value);
-        cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
-        cl::Event event;
-        _queue.enqueueNDRangeKernel(kernel_, {}, {buffer.size_, 1, 1}, {}, &events, &event);
-        return event;
+        return Enqueue({buffer.size_, 1, 1}, cl::NullRange, queue, events);
     }
 };
 
@@ -39,10 +38,7 @@ class ImageAddKernel : gls::GpuKernel
                          const std::vector<cl::Event>& events = {})
     {
         SetArgs(image, value, image);
-        cl::CommandQueue _queue = queue.value_or(gpu_context_->clCommandQueue());
-        cl::Event event;
-        _queue.enqueueNDRangeKernel(kernel_, {}, {image.width_, image.height_, 1}, {}, &events, &event);
-        return event;
+        return Enqueue({image.width_, image.height_, 1}, cl::NullRange, queue, events);
     }
 };
 
@@ -87,3 +83,191 @@ TEST(GpuKernelTest, ImageKernel)
 
     cpu_image.apply([&](float* pixel, int x, int y) { EXPECT_EQ(*pixel, input_image[y][x] + add_value); });
 }
+
+TEST(GpuKernelTest, ProgramBinaryCache)
+{
+    const auto cache_directory = std::filesystem::temp_directory_path() / "glass_image_program_cache_test";
+    std::filesystem::remove_all(cache_directory);
+    gls::setProgramCacheDirectory(cache_directory.string());
+
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    for (int run = 0; run < 2; run++)
+    {
+        // The first run compiles the sources and saves the binary, the second one loads it
+        auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+        gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+        EXPECT_EQ(std::distance(std::filesystem::directory_iterator(cache_directory),
+                                std::filesystem::directory_iterator()),
+                  1);
+
+        vector<float> data(12);
+        std::iota(data.begin(), data.end(), 0.0f);
+        gls::GpuBuffer<float> buffer(gpu_context, data);
+
+        BufferAddKernel kernel(gpu_context);
+        kernel(buffer, 1.5f).wait();
+
+        vector<float> result = buffer.ToVector();
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            EXPECT_EQ(data[i] + 1.5f, result[i]);
+        }
+    }
+
+    // A new version salt, e.g.: after an included header changed, doesn't load the previous binary
+    gls::setProgramCacheDirectory(cache_directory.string(), "v2");
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+    EXPECT_EQ(
+        std::distance(std::filesystem::directory_iterator(cache_directory), std::filesystem::directory_iterator()), 2);
+
+    gls::setProgramCacheDirectory("");
+    std::filesystem::remove_all(cache_directory);
+}
+
+TEST(GpuKernelTest, KernelCache)
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+
+    // One kernel object per thread, reused by every dispatch from that thread
+    cl_kernel kernel = gpu_context->kernel("BufferAddKernel")();
+    EXPECT_EQ(gpu_context->kernel("BufferAddKernel")(), kernel);
+    EXPECT_NE(gpu_context->kernel("ImageAddKernel")(), kernel);
+
+    cl::Kernel other_thread_kernel;
+    std::thread([&] { other_thread_kernel = gpu_context->kernel("BufferAddKernel"); }).join();
+    EXPECT_NE(other_thread_kernel(), kernel);
+
+    // The kernels of a thread are released when it exits
+    EXPECT_EQ(gpu_context->kernelCacheThreadCount(), 1);
+
+    // Reloading the program drops the cached kernels
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+    EXPECT_EQ(gpu_context->kernel("BufferAddKernel").getInfo<CL_KERNEL_PROGRAM>()(), gpu_context->clProgram()());
+}
+
+TEST(GpuKernelTest, TypedDispatch)
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+
+    vector<float> data(12);
+    std::iota(data.begin(), data.end(), 0.0f);
+    gls::GpuBuffer<float> buffer(gpu_context, data);
+
+    // Arguments bound by type, through OCLContext directly and through the OCLKernel wrapper
+    gpu_context->dispatch("BufferAddKernel", gls::size(12, 1), {0, 0}, {}, buffer.buffer(), 1.0f).wait();
+
+    gls::OCLKernel<cl::Buffer, float> kernel(gpu_context.get(), "BufferAddKernel");
+    kernel(*gpu_context, gls::size(12, 1), buffer.buffer(), 0.5f).wait();
+
+    vector<float> result = buffer.ToVector();
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        EXPECT_EQ(data[i] + 1.5f, result[i]);
+    }
+}
+
+TEST(GpuKernelTest, WorkGroupCandidates)
+{
+    // The driver's choice first, then power of 2 sizes dividing the grid
+    auto candidates = gls::OCLWorkGroupTuner::candidateSizes(gls::size(1920, 1080), 256);
+    ASSERT_FALSE(candidates.empty());
+    EXPECT_EQ(candidates[0], gls::size(0, 0));
+    for (size_t i = 1; i < candidates.size(); i++)
+    {
+        const int items = candidates[i].width * candidates[i].height;
+        EXPECT_TRUE(items >= 32 && items <= 256 && (items & (items - 1)) == 0);
+        EXPECT_EQ(1920 % candidates[i].width, 0);
+        EXPECT_EQ(1080 % candidates[i].height, 0);
+    }
+
+    // 1D grids only get 1D work groups, bounded by the kernel's max work group size
+    candidates = gls::OCLWorkGroupTuner::candidateSizes(gls::size(4096, 1), 64);
+    EXPECT_EQ(candidates, (vector<gls::size>{{0, 0}, {32, 1}, {64, 1}}));
+}
+
+TEST(GpuKernelTest, WorkGroupTuning)
+{
+    const std::string tuning_file =
+        (std::filesystem::temp_directory_path() / "gls_work_group_tuning_test.tsv").string();
+    std::filesystem::remove(tuning_file);
+
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "", CL_QUEUE_PROFILING_ENABLE);
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+    gpu_context->enableWorkGroupTuning(tuning_file);
+
+    vector<float> data(4096, 0.0f);
+    gls::GpuBuffer<float> buffer(gpu_context, data);
+
+    // Every dispatch produces the right result while the candidates are timed
+    const gls::size grid(4096, 1);
+    const int dispatches = 100;
+    for (int i = 0; i < dispatches; i++)
+    {
+        gpu_context->dispatch("BufferAddKernel", grid, {0, 0}, {}, buffer.buffer(), 1.0f).wait();
+    }
+    vector<float> result = buffer.ToVector();
+    for (float value : result)
+    {
+        EXPECT_EQ(value, dispatches);
+    }
+
+    const auto tuned = gpu_context->workGroupTuner()->tunedSize("BufferAddKernel", grid);
+    ASSERT_TRUE(tuned.has_value());
+
+    // A new tuner picks the result up from the tuning file
+    gls::OCLWorkGroupTuner reloaded(cl::Device::getDefault(), tuning_file);
+    EXPECT_EQ(reloaded.tunedSize("BufferAddKernel", grid), tuned);
+
+    gpu_context->disableWorkGroupTuning();
+    std::filesystem::remove(tuning_file);
+}
+
+TEST(GpuKernelTest, Profiler)
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "", CL_QUEUE_PROFILING_ENABLE);
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+    gpu_context->enableProfiling();
+
+    vector<float> data(1024, 0.0f);
+    gls::GpuBuffer<float> buffer(gpu_context, data);
+    BufferAddKernel add(gpu_context);
+
+    // Dispatches through GpuKernel and through OCLContext, plus a transfer
+    add(buffer, 1.0f);
+    add(buffer, 1.0f);
+    gpu_context->dispatch("BufferAddKernel", gls::size(1024, 1), {0, 0}, {}, buffer.buffer(), 1.0f);
+    vector<float> result = buffer.ToVector();
+    EXPECT_EQ(result[0], 3.0f);
+
+    auto profiler = gpu_context->profiler();
+    const auto records = profiler->records();
+    ASSERT_EQ(records.size(), 4);
+    for (const auto& record : records)
+    {
+        EXPECT_LE(record.queued, record.submit);
+        EXPECT_LE(record.submit, record.start);
+        EXPECT_LE(record.start, record.end);
+    }
+    EXPECT_EQ(records[0].name, "BufferAddKernel");
+    EXPECT_EQ(records[0].globalSize, (std::array<size_t, 3>{1024, 1, 1}));
+    EXPECT_EQ(records[3].category, "transfer");
+
+    const auto statistics = profiler->statistics();
+    EXPECT_EQ(statistics.at("BufferAddKernel").count, 3);
+    EXPECT_EQ(statistics.at("GpuBuffer::ToVector").count, 1);
+    EXPECT_LE(statistics.at("BufferAddKernel").minMs, statistics.at("BufferAddKernel").maxMs);
+
+    const std::string trace = profiler->chromeTrace();
+    EXPECT_NE(trace.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"BufferAddKernel\""), std::string::npos);
+
+    profiler->clear();
+    EXPECT_TRUE(profiler->records().empty());
+}
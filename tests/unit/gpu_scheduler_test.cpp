@@ -0,0 +1,104 @@
+#include "glass_image/gpu_scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "glass_image/gpu_buffer.h"
+#include "glass_image/gpu_image.h"
+#include "glass_image/gpu_utils.h"
+#include "testing_kernels.h"
+
+using std::vector;
+using OperationId = gls::GpuScheduler::OperationId;
+
+static std::shared_ptr<gls::OCLContext> CreateContext()
+{
+    std::vector<std::string> kernel_sources{testing_kernel_code};
+    auto gpu_context = std::make_shared<gls::OCLContext>(kernel_sources, "");
+    gpu_context->loadProgramsFromFullStringSource(kernel_sources, "");
+    return gpu_context;
+}
+
+TEST(GpuSchedulerTest, Hazards)
+{
+    auto gpu_context = CreateContext();
+    gls::GpuBuffer<float> a(gpu_context, 256), b(gpu_context, 256), c(gpu_context, 256);
+    vector<float> input(256), output(256);
+
+    gls::GpuScheduler scheduler(gpu_context);
+    auto nop = [](const cl::CommandQueue&, const std::vector<cl::Event>&) { return cl::Event(); };
+
+    const OperationId upload = scheduler.Upload(a, std::span<float>(input));
+    const OperationId first = scheduler.Kernel("first", {gls::GpuRead(a), gls::GpuWrite(b)}, nop);
+    const OperationId second = scheduler.Kernel("second", {gls::GpuRead(b), gls::GpuWrite(c)}, nop);
+    const OperationId download = scheduler.Download(c, std::span<float>(output));
+    const OperationId reupload = scheduler.Upload(a, std::span<float>(input));
+
+    // Read after write across queues
+    EXPECT_EQ(scheduler.Dependencies(first), vector<OperationId>{upload});
+    // Implied by the in-order compute queue
+    EXPECT_TRUE(scheduler.Dependencies(second).empty());
+    EXPECT_EQ(scheduler.Dependencies(download), vector<OperationId>{second});
+    // Write after read, the write after write on the upload queue is implied
+    EXPECT_EQ(scheduler.Dependencies(reupload), vector<OperationId>{first});
+}
+
+TEST(GpuSchedulerTest, AliasedMemory)
+{
+    auto gpu_context = CreateContext();
+    const size_t width = 64, height = 16;
+    gls::GpuBuffer<float> buffer(gpu_context, gls::image_utils::GetBestRowPitch<float>(width) * height);
+    gls::GpuImage<float> image(gpu_context, buffer, width, height);
+    gls::GpuBuffer<float> other(gpu_context, 256);
+
+    // An image created from a buffer resolves to the buffer's storage
+    const auto image_range = gls::GpuScheduler::ResolveMemory(image.image());
+    const auto buffer_range = gls::GpuScheduler::ResolveMemory(buffer.buffer());
+    EXPECT_EQ(image_range.root, buffer_range.root);
+    EXPECT_TRUE(image_range.Overlaps(buffer_range));
+    EXPECT_FALSE(gls::GpuScheduler::ResolveMemory(other.buffer()).Overlaps(buffer_range));
+
+    gls::GpuScheduler scheduler(gpu_context, 1);
+    auto nop = [](const cl::CommandQueue&, const std::vector<cl::Event>&) { return cl::Event(); };
+    const OperationId write = scheduler.Kernel("write", {gls::GpuWrite(image)}, nop);
+    const OperationId read = scheduler.HostOperation("read", {gls::GpuRead(buffer)}, [] {});
+    const OperationId unrelated = scheduler.HostOperation("unrelated", {gls::GpuRead(other)}, [] {});
+    EXPECT_EQ(scheduler.Dependencies(read), vector<OperationId>{write});
+    EXPECT_TRUE(scheduler.Dependencies(unrelated).empty());
+}
+
+TEST(GpuSchedulerTest, OverlappedFrames)
+{
+    auto gpu_context = CreateContext();
+    const size_t size = 4096;
+    gls::GpuBuffer<float> buffer(gpu_context, size);
+    vector<float> input(size), output(size);
+
+    // Upload, add 1 twice and read back, over three queues
+    gls::GpuScheduler scheduler(gpu_context);
+    scheduler.Upload(buffer, std::span<float>(input));
+    for (int i = 0; i < 2; i++)
+    {
+        scheduler.Kernel("add", {gls::GpuRead(buffer), gls::GpuWrite(buffer)},
+                         [&](const cl::CommandQueue& queue, const std::vector<cl::Event>& events) {
+                             return gpu_context->dispatch(queue, "BufferAddKernel", gls::size(size, 1), {0, 0}, events,
+                                                          buffer.buffer(), 1.0f);
+                         });
+    }
+    scheduler.Download(buffer, std::span<float>(output));
+
+    for (int frame = 0; frame < 3; frame++)
+    {
+        std::iota(input.begin(), input.end(), (float)frame);
+        cl::Event::waitForEvents(scheduler.Execute());
+        for (size_t i = 0; i < size; i++)
+        {
+            ASSERT_EQ(output[i], i + frame + 2);
+        }
+    }
+    scheduler.Finish();
+}
@@ -0,0 +1,61 @@
+#include "gls_image.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+template <typename T>
+static bool IsAligned(const T* pointer, size_t alignment)
+{
+    return reinterpret_cast<uintptr_t>(pointer) % alignment == 0;
+}
+
+TEST(ImageAllocationTest, DefaultAlignment)
+{
+    // Owning images are cache line aligned, the stride is unchanged
+    gls::image<gls::rgb_pixel> image(33, 7);
+    EXPECT_EQ(image.stride, 33);
+    EXPECT_TRUE(IsAligned(image[0], 64));
+
+    // Pixels are default initialized, as with new T[]
+    gls::image<gls::pixel_float4> float_image(5, 5);
+    EXPECT_TRUE(IsAligned(float_image[0], 64));
+}
+
+TEST(ImageAllocationTest, PaddedStride)
+{
+    const gls::image_allocation padded{.pad_stride = true};
+
+    // Rows are aligned
+    gls::image<float> image(1001, 4, padded);
+    EXPECT_EQ(image.stride, 1008);
+    for (int y = 0; y < image.height; y++)
+    {
+        EXPECT_TRUE(IsAligned(image[y], 64));
+    }
+
+    // Power of two widths get an extra cache line
+    EXPECT_EQ(padded.stride<float>(1024), 1024 + 16);
+    EXPECT_EQ(padded.stride<uint16_t>(8192), 8192 + 32);
+
+    // Pixel sizes which don't divide the alignment
+    const int stride = padded.stride<gls::rgb_pixel>(100);
+    EXPECT_GE(stride, 100);
+    EXPECT_EQ(stride * sizeof(gls::rgb_pixel) % 64, 0);
+
+    EXPECT_EQ(gls::image_allocation().stride<float>(1024), 1024);
+}
+
+TEST(ImageAllocationTest, HugePages)
+{
+    const gls::image_allocation huge{.pad_stride = true, .huge_pages = true};
+
+    // Large allocations are huge page aligned, small ones use the regular alignment
+    gls::image<gls::pixel_float4> large(1024, 256, huge);
+    EXPECT_TRUE(IsAligned(large[0], gls::image_allocation::huge_page_size));
+    large[large.height - 1][large.width - 1] = {1, 2, 3, 4};
+
+    EXPECT_EQ(huge.storage_alignment<float>(1024), 64);
+    EXPECT_EQ(huge.storage_alignment<float>(gls::image_allocation::huge_page_size),
+              gls::image_allocation::huge_page_size);
+}
@@ -0,0 +1,60 @@
+#include "gls_image_arena.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+TEST(ImageArenaTest, Scopes)
+{
+    gls::image_arena arena(1024 * 1024);
+
+    const void* first_pixels = nullptr;
+    for (int frame = 0; frame < 3; frame++)
+    {
+        auto scope = arena.make_scope();
+        auto a = scope.make_image<float>(100, 100);
+        auto b = scope.make_image<gls::rgba_pixel>(gls::size(33, 10));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(a[0]) % 64, 0);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(b[0]) % 64, 0);
+        EXPECT_GE((const std::byte*)b[0], (const std::byte*)(a[0] + a.stride * a.height));
+        a[99][99] = frame;
+        b[9][32] = {1, 2, 3, 4};
+
+        // Every frame reuses the same memory
+        if (frame == 0)
+        {
+            first_pixels = a[0];
+        }
+        EXPECT_EQ(a[0], first_pixels);
+        EXPECT_GT(arena.used(), 0);
+    }
+    EXPECT_EQ(arena.used(), 0);
+    EXPECT_EQ(arena.capacity(), 1024 * 1024);
+}
+
+TEST(ImageArenaTest, Growth)
+{
+    gls::image_arena arena(64 * 1024, {.pad_stride = true});
+
+    // Larger than a block
+    auto large = arena.make_image<float>(1024, 64);
+    EXPECT_EQ(large.stride, 1024 + 16);
+    EXPECT_GT(arena.capacity(), 1024 * 64 * sizeof(float));
+
+    const auto mark = arena.position();
+    auto small = arena.make_image<uint8_t>(16, 16);
+    auto other = arena.make_image<uint8_t>(16, 16);
+    EXPECT_NE(small[0], other[0]);
+
+    // Rewinding releases the images created after the mark
+    arena.rewind(mark);
+    auto reused = arena.make_image<uint8_t>(16, 16);
+    EXPECT_EQ(reused[0], small[0]);
+
+    const size_t capacity = arena.capacity();
+    arena.reset();
+    EXPECT_EQ(arena.used(), 0);
+    auto again = arena.make_image<float>(1024, 64);
+    EXPECT_EQ(again[0], large[0]);
+    EXPECT_EQ(arena.capacity(), capacity);
+}
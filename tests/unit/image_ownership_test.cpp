@@ -0,0 +1,113 @@
+#include "gls_image.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+static_assert(!std::is_copy_constructible_v<gls::image<float>>);
+static_assert(!std::is_copy_assignable_v<gls::image<float>>);
+static_assert(std::is_nothrow_move_constructible_v<gls::image<float>>);
+static_assert(std::is_nothrow_move_assignable_v<gls::image<float>>);
+
+TEST(ImageOwnershipTest, Move)
+{
+    gls::image<float> image(64, 32);
+    image[31][63] = 42;
+    const float* pixels = image[0];
+
+    // The storage is transferred, no pixels are copied
+    gls::image<float> moved(std::move(image));
+    EXPECT_EQ(moved[0], pixels);
+    EXPECT_EQ(moved.size(), gls::size(64, 32));
+    EXPECT_EQ(moved[31][63], 42);
+    EXPECT_EQ(image.width, 0);
+    EXPECT_TRUE(image.pixels().empty());
+    EXPECT_EQ(image.storage(), nullptr);
+
+    gls::image<float> assigned(1, 1);
+    assigned = std::move(moved);
+    EXPECT_EQ(assigned[0], pixels);
+    EXPECT_EQ(assigned.stride, 64);
+
+    // Images can be held by value in containers
+    std::vector<gls::image<float>> images;
+    for (int i = 0; i < 10; i++)
+    {
+        images.emplace_back(16, 16);
+        images.back()[0][0] = i;
+    }
+    images.push_back(std::move(assigned));
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_EQ(images[i][0][0], i);
+    }
+    EXPECT_EQ(images.back()[0], pixels);
+}
+
+TEST(ImageOwnershipTest, MoveAssignKeepsShapeAndStorageConsistent)
+{
+    // A padded source, so that width and stride differ
+    gls::image<float> source(100, 20, gls::image_allocation{.pad_stride = true});
+    ASSERT_GT(source.stride, source.width);
+    const int stride = source.stride;
+    const auto storage = source.storage();
+    const float* pixels = source[0];
+
+    gls::image<float> target(8, 300);
+    target = std::move(source);
+    EXPECT_EQ(target.size(), gls::size(100, 20));
+    EXPECT_EQ(target.stride, stride);
+    EXPECT_EQ(target.pixels().size(), (size_t)stride * 20);
+    EXPECT_EQ(target.storage(), storage);
+    EXPECT_EQ(target[19], pixels + 19 * stride);
+
+    // The source is left empty, with a consistent zero shape
+    EXPECT_EQ(source.size(), gls::size(0, 0));
+    EXPECT_EQ(source.stride, 0);
+    EXPECT_TRUE(source.pixels().empty());
+    EXPECT_EQ(source.storage(), nullptr);
+}
+
+TEST(ImageOwnershipTest, Views)
+{
+    std::unique_ptr<gls::image<int>> parent = std::make_unique<gls::image<int>>(100, 100);
+    parent->parallel_for_each_pixel([](int* pixel, int x, int y) { *pixel = 1000 * y + x; });
+
+    // A view keeps its parent's storage alive
+    gls::image<int> view(*parent, gls::rectangle(10, 20, 30, 40));
+    EXPECT_EQ(view.storage(), parent->storage());
+    EXPECT_EQ(parent->storage().use_count(), 2);
+    parent.reset();
+    EXPECT_EQ(view.storage().use_count(), 1);
+    EXPECT_EQ(view[0][0], 20010);
+    EXPECT_EQ(view[39][29], 59039);
+
+    // Clones own new storage
+    gls::image<int> copy = view.clone();
+    EXPECT_NE(copy.storage(), view.storage());
+    EXPECT_EQ(copy.stride, 30);
+    EXPECT_EQ(copy[39][29], 59039);
+    copy[0][0] = 0;
+    EXPECT_EQ(view[0][0], 20010);
+}
+
+TEST(ImageOwnershipTest, ExternalStorage)
+{
+    // Caller owned memory, released by the storage owner with the last image referencing it
+    bool released = false;
+    std::vector<float> memory(8 * 8);
+    {
+        std::shared_ptr<void> owner(memory.data(), [&released](void*) { released = true; });
+        gls::image<float> image(8, 8, 8, std::span<float>(memory), std::move(owner));
+        gls::image<float> view(image, 2, 2, 4, 4);
+        { auto moved = std::move(image); }
+        EXPECT_FALSE(released);
+    }
+    EXPECT_TRUE(released);
+
+    // Plain wrappers have no storage owner
+    gls::image<float> wrapper(8, 8, std::span<float>(memory));
+    EXPECT_EQ(wrapper.storage(), nullptr);
+}
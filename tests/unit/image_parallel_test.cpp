@@ -0,0 +1,61 @@
+#include "gls_image.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <span>
+#include <vector>
+
+TEST(ImageParallelTest, ForEachRow)
+{
+    // Stride larger than the width, the spans must only cover the image pixels
+    std::vector<float> storage(40 * 300, -1.0f);
+    gls::image<float> image(37, 300, 40, std::span<float>(storage));
+
+    image.parallel_for_each_row(
+        [&](std::span<float> row, int y)
+        {
+            ASSERT_EQ(row.size(), image.width);
+            for (size_t x = 0; x < row.size(); x++) row[x] = y * 1000 + x;
+        });
+
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++) ASSERT_EQ(image[y][x], y * 1000 + x);
+        for (int x = image.width; x < image.stride; x++) ASSERT_EQ(image[y][x], -1.0f);
+    }
+
+    std::atomic<int> rows = 0;
+    const gls::image<float>& const_image = image;
+    const_image.parallel_for_each_row([&](std::span<const float>, int) { rows++; }, 4);
+    EXPECT_EQ(rows, image.height);
+}
+
+TEST(ImageParallelTest, ForEachPixelSignatures)
+{
+    gls::image<gls::luma_pixel_16> image(1000, 100);
+
+    image.parallel_for_each_pixel([](gls::luma_pixel_16* pixel, int x, int y) { *pixel = x + y; });
+    image.apply([](const gls::luma_pixel_16& pixel, int x, int y) { ASSERT_EQ(pixel, x + y); });
+
+    image.parallel_for_each_pixel([](gls::luma_pixel_16& pixel, int x, int y) { pixel = x * y % 65536; });
+    image.apply([](const gls::luma_pixel_16& pixel, int x, int y) { ASSERT_EQ(pixel, x * y % 65536); });
+
+    image.parallel_for_each_pixel([](gls::luma_pixel_16& pixel) { pixel = 7; });
+
+    std::atomic<int64_t> sum = 0;
+    const gls::image<gls::luma_pixel_16>& const_image = image;
+    const_image.parallel_for_each_pixel([&](const gls::luma_pixel_16& pixel) { sum += pixel; });
+    EXPECT_EQ(sum, 7 * image.width * image.height);
+}
+
+TEST(ImageParallelTest, Exceptions)
+{
+    gls::image<float> image(256, 256);
+    EXPECT_THROW(image.parallel_for_each_pixel(
+                     [](float&, int x, int y)
+                     {
+                         if (x == 100 && y == 200) throw std::runtime_error("Bad pixel");
+                     }),
+                 std::runtime_error);
+}
@@ -0,0 +1,84 @@
+#include "gls_raw_unpack.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+using gls::raw_packing;
+using std::vector;
+
+namespace
+{
+
+// Straightforward reference packers
+vector<uint8_t> Pack(raw_packing packing, const vector<uint16_t>& samples)
+{
+    const int bits = gls::raw_packing_bits(packing);
+    vector<uint8_t> packed(gls::packed_raw_size(packing, samples.size()), 0);
+    if (packing == raw_packing::mipi_raw10 || packing == raw_packing::mipi_raw12)
+    {
+        const int group = packing == raw_packing::mipi_raw10 ? 4 : 2;
+        const int low_bits = bits - 8;
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            uint8_t* base = &packed[i / group * (group + 1)];
+            const int j = i % group;
+            base[j] = samples[i] >> low_bits;
+            base[group] |= (samples[i] & ((1 << low_bits) - 1)) << (j * low_bits);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            for (int b = 0; b < bits; b++)
+            {
+                const size_t bit = i * bits + b;
+                if (samples[i] & (1 << (bits - 1 - b)))
+                {
+                    packed[bit / 8] |= 0x80 >> (bit % 8);
+                }
+            }
+        }
+    }
+    return packed;
+}
+
+}  // namespace
+
+TEST(RawUnpackTest, MatchesReferencePacking)
+{
+    std::mt19937 generator(7);
+    for (auto packing : {raw_packing::msb_10, raw_packing::msb_12, raw_packing::msb_14, raw_packing::mipi_raw10,
+                         raw_packing::mipi_raw12})
+    {
+        const int bits = gls::raw_packing_bits(packing);
+        // Lengths around the SIMD group sizes, exercising the scalar tails
+        for (size_t count : {1, 2, 3, 7, 8, 9, 15, 16, 17, 24, 31, 32, 33, 100, 1001, 4096})
+        {
+            vector<uint16_t> samples(count);
+            for (auto& sample : samples)
+            {
+                sample = generator() & ((1 << bits) - 1);
+            }
+            const auto packed = Pack(packing, samples);
+
+            for (bool use_simd : {false, true})
+            {
+                vector<uint16_t> unpacked(count, 0xffff);
+                gls::unpack_raw(packing, packed.data(), unpacked.data(), count, use_simd);
+                ASSERT_EQ(unpacked, samples) << "bits: " << bits << ", count: " << count << ", simd: " << use_simd;
+            }
+        }
+    }
+}
+
+TEST(RawUnpackTest, PackedSize)
+{
+    EXPECT_EQ(gls::packed_raw_size(raw_packing::msb_10, 4), 5);
+    EXPECT_EQ(gls::packed_raw_size(raw_packing::msb_12, 3), 5);
+    EXPECT_EQ(gls::packed_raw_size(raw_packing::msb_14, 4), 7);
+    EXPECT_EQ(gls::packed_raw_size(raw_packing::mipi_raw10, 5), 10);
+    EXPECT_EQ(gls::packed_raw_size(raw_packing::mipi_raw12, 3), 6);
+}
@@ -0,0 +1,118 @@
+#include "gls_parallel.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gls_image.hpp"
+
+// Restores the default thread pool configuration for the tests that follow, whatever the test configured
+struct DefaultThreadPoolRestorer
+{
+    ~DefaultThreadPoolRestorer() { gls::configure_thread_pool(0); }
+};
+
+TEST(ThreadPoolTest, ParallelFor)
+{
+    gls::thread_pool pool(3);
+    EXPECT_EQ(pool.size(), 3);
+
+    std::vector<std::atomic<int>> visits(1000);
+    pool.parallel_for(1000, 4, [&](int i) { visits[i]++; });
+    for (const auto& v : visits)
+    {
+        ASSERT_EQ(v, 1);
+    }
+}
+
+TEST(ThreadPoolTest, NestedParallelFor)
+{
+    // Every worker blocks in an outer item while the inner loops run
+    gls::thread_pool pool(2);
+    std::atomic<int> sum = 0;
+    pool.parallel_for(8, 8, [&](int) { pool.parallel_for(100, 8, [&](int j) { sum += j; }); });
+    EXPECT_EQ(sum, 8 * 4950);
+}
+
+TEST(ThreadPoolTest, Exceptions)
+{
+    gls::thread_pool pool(2);
+    std::atomic<int> processed = 0;
+    EXPECT_THROW(pool.parallel_for(1000, 3,
+                                   [&](int i)
+                                   {
+                                       if (i == 10) throw std::runtime_error("failed");
+                                       processed++;
+                                   }),
+                 std::runtime_error);
+    EXPECT_LT(processed, 1000);
+
+    // The pool is still usable
+    processed = 0;
+    pool.parallel_for(100, 3, [&](int) { processed++; });
+    EXPECT_EQ(processed, 100);
+}
+
+TEST(ThreadPoolTest, Submit)
+{
+    gls::thread_pool pool(2, {0});
+    std::promise<int> promise;
+    pool.submit([&]() { promise.set_value(42); });
+    EXPECT_EQ(promise.get_future().get(), 42);
+}
+
+TEST(ThreadPoolTest, ParallelRowsAndTiles)
+{
+    DefaultThreadPoolRestorer restorer;
+    gls::configure_thread_pool(3);
+
+    gls::image<int> image(1000, 70);
+    gls::parallel_rows(image, [&](int y)
+                       {
+                           for (int x = 0; x < image.width; x++) image[y][x] = 0;
+                       });
+
+    // Tiles on the edges are clipped
+    gls::parallel_tiles(image, {128, 32},
+                        [&](const gls::rectangle& tile)
+                        {
+                            for (int y = tile.y; y < tile.y + tile.height; y++)
+                                for (int x = tile.x; x < tile.x + tile.width; x++) image[y][x]++;
+                        });
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            ASSERT_EQ(image[y][x], 1);
+        }
+    }
+}
+
+TEST(ThreadPoolTest, ThreadsCappedToPoolSize)
+{
+    // Never more threads than the pool's workers plus the caller, whatever max_threads asks for
+    DefaultThreadPoolRestorer restorer;
+    gls::configure_thread_pool(1);
+
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    gls::parallel_for(1000, 16,
+                      [&](int)
+                      {
+                          std::lock_guard<std::mutex> guard(mutex);
+                          threads.insert(std::this_thread::get_id());
+                      });
+    EXPECT_LE(threads.size(), 2);
+}
+
+TEST(ThreadPoolTest, ConfigurationRestored)
+{
+    // Runs after the tests above, which configured smaller pools
+    EXPECT_EQ(gls::default_thread_pool()->size(), gls::thread_pool().size());
+}